@@ -0,0 +1,55 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# define UnpackedDevice	object "/usr/MsgServer/benchmark/lib/UnpackedDevice"
+
+
+private string id;
+private mapping devices;
+private string phoneNumber;
+private string pni;
+private string pin;
+private int pniRegistrationId;
+private string recoveryPassword;
+private string registrationLock;
+private string signalingKey;
+private string unidentifiedAccessKey;
+private string identityKey;
+private string pniKey;
+private int flags;
+
+/*
+ * an account in the layout used before packed records, from a packed record
+ */
+static void create(mixed *record)
+{
+    int *deviceIds, i;
+    mixed **records;
+
+    ({
+	id, devices, phoneNumber, pni, pin, pniRegistrationId,
+	recoveryPassword, registrationLock, signalingKey,
+	unidentifiedAccessKey, identityKey, pniKey, flags
+    }) = record;
+    deviceIds = map_indices(devices);
+    records = map_values(devices);
+    devices = ([ ]);
+    for (i = sizeof(records); --i >= 0; ) {
+	devices[deviceIds[i]] = new UnpackedDevice(records[i]);
+    }
+}
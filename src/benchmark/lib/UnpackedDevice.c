@@ -0,0 +1,50 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# include "Timestamp.h"
+
+
+private int id;
+private int registrationId;
+private string authToken;
+private string salt;
+private string name;
+private string agent;
+private int pkId;
+private string preKey;
+private string pkSignature;
+private int pniPkId;
+private string pniPreKey;
+private string pniPkSignature;
+private string gcmId;
+private int cap;
+private Timestamp created;
+private Timestamp lastSeen;
+
+/*
+ * a device in the layout used before packed records, from a packed record
+ */
+static void create(mixed *record)
+{
+    ({
+	id, registrationId, authToken, salt, name, agent, pkId, preKey,
+	pkSignature, pniPkId, pniPreKey, pniPkSignature, gcmId, cap
+    }) = record[.. 13];
+    created = new Timestamp(record[14] * 1000);
+    lastSeen = new Timestamp(record[15], TRUE);
+}
@@ -0,0 +1,114 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# include "account.h"
+
+private inherit "~/lib/phone";
+private inherit base64 "/lib/util/base64";
+
+
+# define ACCOUNTS		200000	/* accounts created by benchmark.c */
+# define TASKS			2000	/* concurrent tasks */
+# define AUTHS			50	/* authentications per task */
+
+object user;			/* user to report to */
+int counter;			/* finished tasks */
+int writes;			/* authentications that modified an account */
+int startTime;			/* start time */
+float startMtime;		/* start time, fraction */
+
+/*
+ * initialize authentication benchmark
+ */
+static void create()
+{
+    user = this_user();
+    call_out("start", 0);
+}
+
+/*
+ * start all tasks at once, so Hydra can run them in parallel
+ */
+static void start()
+{
+    int i;
+
+    ({ startTime, startMtime }) = millitime();
+    user->message("Started " + ctime(startTime) + "\n");
+    for (i = 0; i < TASKS; i++) {
+	call_out("authenticate", 0);
+    }
+}
+
+/*
+ * authenticate random devices, as is done for each authenticated request,
+ * and count the authentications that modified the stored account
+ */
+static void authenticate()
+{
+    int i, lastSeen, modified;
+    string phoneNumber;
+    Account account;
+    Device device;
+
+    for (i = 0; i < AUTHS; i++) {
+	phoneNumber = "+155" + (50000000 + random(ACCOUNTS));
+	account = ACCOUNT_SERVER->getByNumber(phoneNumber);
+	device = account->device(1);
+	lastSeen = device->lastSeen()->time();
+	if (!device->verifyPassword(base64::encode("\0\0\0\0\0\0\0\0\0\0" +
+						   phoneToNum(phoneNumber)))) {
+	    error("Authentication failed");
+	}
+	if (device->lastSeen()->time() != lastSeen) {
+	    modified++;
+	}
+    }
+    if (modified != 0) {
+	call_out_summand("written", 0, (float) modified);
+    }
+    call_out_summand("done", 0, 1.0);
+}
+
+/*
+ * count authentications that modified an account
+ */
+static void written(float number)
+{
+    writes += (int) number;
+}
+
+/*
+ * count finished tasks
+ */
+static void done(float number)
+{
+    int time;
+    float mtime, elapsed;
+
+    counter += (int) number;
+    if (counter == TASKS) {
+	({ time, mtime }) = millitime();
+	elapsed = (float) (time - startTime) + mtime - startMtime;
+	user->message("Done: " + (TASKS * AUTHS) + " authentications in " +
+		      elapsed + " seconds, " +
+		      (int) ((float) (TASKS * AUTHS) / elapsed) +
+		      " per second, " + writes + " account writes\n");
+	counter = writes = 0;
+    }
+}
@@ -0,0 +1,99 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# include "Deque.h"
+
+
+# define BACKLOG		10000	/* queue length */
+
+object user;			/* user to report to */
+
+/*
+ * initialize queue benchmark
+ */
+static void create()
+{
+    user = this_user();
+    call_out("arrays", 0);
+}
+
+/*
+ * elapsed time since a start time
+ */
+private float elapsed(int startTime, float startMtime)
+{
+    int time;
+    float mtime;
+
+    ({ time, mtime }) = millitime();
+    return (float) (time - startTime) + mtime - startMtime;
+}
+
+/*
+ * fill and empty a queue one element at a time, with array copying
+ */
+static void arrays()
+{
+    int startTime, i;
+    float startMtime;
+    mixed *queue;
+
+    ({ startTime, startMtime }) = millitime();
+    queue = ({ });
+    for (i = 0; i < BACKLOG; i++) {
+	queue += ({ i });
+    }
+    while (sizeof(queue) != 0) {
+	queue = queue[1 ..];
+    }
+    user->message("Arrays: " + BACKLOG + " elements in " +
+		  elapsed(startTime, startMtime) + " seconds\n");
+    call_out("deques", 0);
+}
+
+/*
+ * fill and empty a queue one element at a time, then fill it again and
+ * drain it at once
+ */
+static void deques()
+{
+    int startTime, i;
+    float startMtime;
+    Deque queue;
+
+    ({ startTime, startMtime }) = millitime();
+    queue = new Deque();
+    for (i = 0; i < BACKLOG; i++) {
+	queue->push(i);
+    }
+    while (queue->size() != 0) {
+	queue->pop();
+    }
+    user->message("Deque: " + BACKLOG + " elements in " +
+		  elapsed(startTime, startMtime) + " seconds\n");
+
+    ({ startTime, startMtime }) = millitime();
+    for (i = 0; i < BACKLOG; i++) {
+	queue->push(i);
+    }
+    if (sizeof(queue->drain()) != BACKLOG) {
+	error("Bad drain");
+    }
+    user->message("Deque with drain: " + BACKLOG + " elements in " +
+		  elapsed(startTime, startMtime) + " seconds\n");
+}
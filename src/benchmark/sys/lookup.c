@@ -0,0 +1,90 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# include "account.h"
+
+
+# define ACCOUNTS		200000	/* accounts created by benchmark.c */
+# define TASKS			2000	/* concurrent tasks */
+# define LOOKUPS		50	/* lookups per task */
+
+object user;			/* user to report to */
+int counter;			/* finished tasks */
+int startTime;			/* start time */
+float startMtime;		/* start time, fraction */
+
+/*
+ * initialize account lookup benchmark
+ */
+static void create()
+{
+    user = this_user();
+    call_out("start", 0);
+}
+
+/*
+ * start all tasks at once, so Hydra can run them in parallel
+ */
+static void start()
+{
+    int i;
+
+    ({ startTime, startMtime }) = millitime();
+    user->message("Started " + ctime(startTime) + "\n");
+    for (i = 0; i < TASKS; i++) {
+	call_out("lookup", 0);
+    }
+}
+
+/*
+ * look up random accounts, by phone number and by account ID
+ */
+static void lookup()
+{
+    int i;
+    Account account;
+
+    for (i = 0; i < LOOKUPS; i++) {
+	account = ACCOUNT_SERVER->getByNumber("+155" +
+					      (50000000 + random(ACCOUNTS)));
+	if (!account || !ACCOUNT_SERVER->get(account->id())) {
+	    error("Account not found");
+	}
+    }
+    call_out_summand("done", 0, 1.0);
+}
+
+/*
+ * count finished tasks
+ */
+static void done(float number)
+{
+    int time;
+    float mtime, elapsed;
+
+    counter += (int) number;
+    if (counter == TASKS) {
+	({ time, mtime }) = millitime();
+	elapsed = (float) (time - startTime) + mtime - startMtime;
+	user->message("Done: " + (2 * TASKS * LOOKUPS) + " lookups in " +
+		      elapsed + " seconds, " +
+		      (int) ((float) (2 * TASKS * LOOKUPS) / elapsed) +
+		      " lookups per second\n");
+	counter = 0;
+    }
+}
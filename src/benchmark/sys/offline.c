@@ -0,0 +1,103 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# include <String.h>
+# include "Timestamp.h"
+# include "account.h"
+# include "messages.h"
+
+private inherit "/lib/util/random";
+
+
+# define ACCOUNTS		200000	/* accounts created by benchmark.c */
+# define CLIENTS		10000	/* accounts connected by benchmark.c */
+# define TASKS			2000	/* concurrent tasks */
+# define MESSAGES		20	/* messages stacked per task */
+# define CONTENT_SIZE		200	/* size of message content */
+
+object user;			/* user to report to */
+string sourceId;		/* account sending the messages */
+int counter;			/* finished tasks */
+int startTime;			/* start time */
+float startMtime;		/* start time, fraction */
+
+/*
+ * initialize offline delivery benchmark
+ */
+static void create()
+{
+    user = this_user();
+    sourceId = ACCOUNT_SERVER->getByNumber("+15550000000")->id();
+    call_out("start", 0);
+}
+
+/*
+ * start all tasks at once, so Hydra can run them in parallel
+ */
+static void start()
+{
+    int i;
+
+    ({ startTime, startMtime }) = millitime();
+    user->message("Started " + ctime(startTime) + "\n");
+    for (i = 0; i < TASKS; i++) {
+	call_out("store", 0);
+    }
+}
+
+/*
+ * store messages for random accounts that are not connected, one message
+ * per call, as is done for a message sent to a device that is offline
+ */
+static void store()
+{
+    int i;
+    string destinationId;
+
+    for (i = 0; i < MESSAGES; i++) {
+	destinationId = ACCOUNT_SERVER->getByNumber("+155" +
+			    (50000000 + CLIENTS +
+			     random(ACCOUNTS - CLIENTS)))->id();
+	MESSAGE_SERVER->stack(({
+	    new Envelope(nil, sourceId, 1, 1,
+			 new String(random_string(CONTENT_SIZE)),
+			 new Timestamp(), destinationId, 1, FALSE)
+	}));
+    }
+    call_out_summand("done", 0, 1.0);
+}
+
+/*
+ * count finished tasks
+ */
+static void done(float number)
+{
+    int time;
+    float mtime, elapsed;
+
+    counter += (int) number;
+    if (counter == TASKS) {
+	({ time, mtime }) = millitime();
+	elapsed = (float) (time - startTime) + mtime - startMtime;
+	user->message("Done: " + (TASKS * MESSAGES) + " messages stored in " +
+		      elapsed + " seconds, " +
+		      (int) ((float) (TASKS * MESSAGES) / elapsed) +
+		      " per second\n");
+	counter = 0;
+    }
+}
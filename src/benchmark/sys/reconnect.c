@@ -0,0 +1,166 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# include <String.h>
+# include "Timestamp.h"
+# include "KVstoreExp.h"
+# include "Deque.h"
+# include "account.h"
+# include "messages.h"
+
+private inherit "/lib/util/random";
+
+
+# define ACCOUNTS		200000	/* accounts created by benchmark.c */
+# define CLIENTS		10000	/* accounts connected by benchmark.c */
+# define BACKLOG		5000	/* messages stored for the device */
+# define BATCH			100	/* messages stacked at once */
+# define RECONNECTS		1000	/* reconnects to measure */
+# define CONTENT_SIZE		200	/* size of message content */
+# define DURATION		3600	/* expiry of the separate mailbox */
+
+object user;			/* user to report to */
+string destinationId;		/* account with a backlog */
+object messages;		/* separate mailbox: stored envelopes */
+Deque queue;			/* separate mailbox: queued GUIDs */
+int reconnects;			/* reconnects so far */
+int received;			/* envelopes received */
+int startTime;			/* start time */
+float startMtime;		/* start time, fraction */
+
+/*
+ * initialize reconnect churn benchmark: store a backlog for a device that is
+ * not connected, and the same backlog in a separate mailbox of the kind a
+ * message shard keeps
+ */
+static void create()
+{
+    string sourceId;
+    Envelope *envelopes;
+    int i, j;
+
+    user = this_user();
+    messages = new KVstoreExp(199, DURATION);
+    queue = new Deque();
+    sourceId = ACCOUNT_SERVER->getByNumber("+15550000000")->id();
+    destinationId = ACCOUNT_SERVER->getByNumber("+155" +
+			(50000000 + CLIENTS +
+			 random(ACCOUNTS - CLIENTS)))->id();
+    for (i = 0; i < BACKLOG; i += BATCH) {
+	envelopes = allocate(BATCH);
+	for (j = 0; j < BATCH; j++) {
+	    envelopes[j] = new Envelope(nil, sourceId, 1, 1,
+					new String(random_string(CONTENT_SIZE)),
+					new Timestamp(), destinationId, 1,
+					FALSE);
+	    messages[envelopes[j]->guid()] = envelopes[j];
+	    queue->push(envelopes[j]->guid());
+	}
+	MESSAGE_SERVER->stack(envelopes);
+    }
+    call_out("start", 0);
+}
+
+/*
+ * start reconnecting
+ */
+static void start()
+{
+    ({ startTime, startMtime }) = millitime();
+    user->message("Started " + ctime(startTime) + "\n");
+    call_out("reconnect", 0);
+}
+
+/*
+ * connect as the device, and disconnect again as soon as the first page
+ * of envelopes arrives, without acknowledging any
+ */
+static void reconnect()
+{
+    MESSAGE_SERVER->send(destinationId, 1, this_object());
+}
+
+/*
+ * report the elapsed time for a number of reconnects
+ */
+private void report(string method, int envelopes)
+{
+    int time;
+    float mtime, elapsed;
+
+    ({ time, mtime }) = millitime();
+    elapsed = (float) (time - startTime) + mtime - startMtime;
+    user->message("Done: " + RECONNECTS + " reconnects with a backlog of " +
+		  BACKLOG + " messages, " + method + ", in " + elapsed +
+		  " seconds, " + (int) ((float) RECONNECTS / elapsed) +
+		  " per second, " + (envelopes / RECONNECTS) +
+		  " envelopes handed out per reconnect\n");
+}
+
+/*
+ * receive a page of stored envelopes
+ */
+void deliverStored(Envelope *list, varargs int more, string accountId,
+		   int deviceId)
+{
+    received += sizeof(list);
+    if (++reconnects < RECONNECTS) {
+	call_out("reconnect", 0);
+    } else {
+	report("resuming from the cursor", received);
+	reconnects = received = 0;
+	({ startTime, startMtime }) = millitime();
+	call_out("restack", 0);
+    }
+}
+
+/*
+ * for comparison, the way connections used to close: the whole backlog was
+ * taken from the mailbox when the device connected, and stacked again when
+ * the connection closed without acknowledging anything; this is done on the
+ * separate mailbox, so the mailbox of the device is left intact
+ */
+static atomic void restack()
+{
+    Envelope *envelopes;
+    string *guids;
+    string guid;
+    int i, sz;
+
+    /* take the whole backlog */
+    guids = queue->drain();
+    envelopes = messages->getMany(guids) - ({ nil });
+    for (i = sizeof(guids); --i >= 0; ) {
+	messages[guids[i]] = nil;
+    }
+
+    /* stack it again */
+    for (i = 0, sz = sizeof(envelopes); i < sz; i++) {
+	guid = envelopes[i]->guid();
+	messages[guid] = envelopes[i];
+	queue->push(guid);
+    }
+
+    received += sz;
+    if (++reconnects < RECONNECTS) {
+	call_out("restack", 0);
+    } else {
+	report("taking and stacking again", received);
+	reconnects = received = 0;
+    }
+}
@@ -0,0 +1,91 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# include "account.h"
+# include <config.h>
+# include <status.h>
+
+
+# define ACCOUNTS		200000	/* accounts created by benchmark.c */
+# define SAMPLES		1000	/* accounts to measure */
+
+# define UnpackedAccount	object "/usr/MsgServer/benchmark/lib/UnpackedAccount"
+# define UnpackedDevice		object "/usr/MsgServer/benchmark/lib/UnpackedDevice"
+
+/*
+ * a copy of a packed account record, with copies of its device records
+ */
+private mixed *copy(mixed *record)
+{
+    mapping devices;
+    int *deviceIds, i;
+    mixed **records;
+
+    record = record[..];
+    deviceIds = map_indices(record[1]);
+    records = map_values(record[1]);
+    devices = ([ ]);
+    for (i = sizeof(records); --i >= 0; ) {
+	devices[deviceIds[i]] = records[i][..];
+    }
+    record[1] = devices;
+    return record;
+}
+
+/*
+ * report measured bytes per account, for accounts as Account and Device
+ * objects in the layout used before packed records, and as packed records;
+ * strings are shared by both and not included.  Run this on an otherwise
+ * idle server, since memory in use is measured for the whole server
+ */
+static void create()
+{
+    mixed **records, *accounts;
+    int memory, packed, objects, i;
+
+    if (status(OBJECT_PATH(UnpackedDevice), O_INDEX) == nil) {
+	compile_object(OBJECT_PATH(UnpackedDevice));
+    }
+    if (status(OBJECT_PATH(UnpackedAccount), O_INDEX) == nil) {
+	compile_object(OBJECT_PATH(UnpackedAccount));
+    }
+
+    records = allocate(SAMPLES);
+    for (i = 0; i < SAMPLES; i++) {
+	records[i] = ACCOUNT_SERVER->getByNumber("+155" +
+				(50000000 + random(ACCOUNTS)))->record();
+    }
+    accounts = allocate(SAMPLES);
+
+    memory = status(ST_DMEMUSED);
+    for (i = 0; i < SAMPLES; i++) {
+	accounts[i] = copy(records[i]);
+    }
+    packed = status(ST_DMEMUSED) - memory;
+    accounts = allocate(SAMPLES);
+
+    memory = status(ST_DMEMUSED);
+    for (i = 0; i < SAMPLES; i++) {
+	accounts[i] = new UnpackedAccount(records[i]);
+    }
+    objects = status(ST_DMEMUSED) - memory;
+
+    this_user()->message("Measured bytes per account: " +
+			 (objects / SAMPLES) + " as objects, " +
+			 (packed / SAMPLES) + " as packed records\n");
+}
@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -21,7 +21,9 @@
 # define Profile		object "/usr/MsgServer/lib/Profile"
 
 # define ACCOUNT_SERVER		"/usr/MsgServer/sys/accounts"
+# define ACCOUNT_SHARD		"/usr/MsgServer/obj/account_shard"
 # define PNI_SERVER		"/usr/MsgServer/sys/pni"
 # define KEYS_SERVER		"/usr/MsgServer/sys/keys"
 # define PROFILE_SERVER		"/usr/MsgServer/sys/profiles"
 # define ONLINE_REGISTRY	"/usr/MsgServer/sys/online"
+# define ONLINE_SHARD		"/usr/MsgServer/obj/online_shard"
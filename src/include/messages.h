@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -19,3 +19,4 @@
 # define Envelope		object "/usr/MsgServer/lib/Envelope"
 
 # define MESSAGE_SERVER		"/usr/MsgServer/sys/messages"
+# define MESSAGE_SHARD		"/usr/MsgServer/obj/message_shard"
@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024-2025 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -16,13 +16,24 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+# include "account.h"
+# include "messages.h"
+
+
+# define SYS_INITD	"/usr/System/initd"
+
 /*
  * initialize message server
  */
 static void create()
 {
+    compile_object("lib/KVkeys");
+    compile_object("lib/KVstoreOrd");
+    compile_object("lib/KVindexed");
     compile_object("lib/KVstoreExp");
     compile_object("lib/KVstoreObj");
+    compile_object("lib/BloomFilter");
+    compile_object("lib/Deque");
     compile_object("lib/Device");
     compile_object("lib/Account");
     compile_object("lib/Profile");
@@ -44,6 +55,10 @@ static void create()
     compile_object("obj/fcm_sender");
     compile_object("obj/kvnode_exp");
     compile_object("obj/kvnode_obj");
+    compile_object("obj/kvwheel_exp");
+    compile_object("obj/account_shard");
+    compile_object("obj/message_shard");
+    compile_object("obj/online_shard");
     compile_object("sys/tls_server");
     compile_object("sys/rest_api");
     compile_object("sys/params");
@@ -87,8 +102,78 @@ int upgrade()
 	compile_object("sys/provisioning");
     }
 
+    if (!find_object("lib/KVstoreOrd")) {
+	/*
+	 * ordered K/V stores
+	 */
+	compile_object("lib/KVkeys");
+	compile_object("lib/KVstoreOrd");
+    }
+
+    if (!find_object("obj/kvwheel_exp")) {
+	/*
+	 * expiry index
+	 */
+	compile_object("obj/kvwheel_exp");
+    }
+
+    if (!find_object("obj/account_shard")) {
+	/*
+	 * sharded account server
+	 */
+	compile_object("obj/account_shard");
+    }
+
+    if (!find_object("lib/KVindexed")) {
+	/*
+	 * indexed K/V stores
+	 */
+	compile_object("lib/KVindexed");
+    }
+
+    if (!find_object("lib/BloomFilter")) {
+	/*
+	 * phone number filter
+	 */
+	compile_object("lib/BloomFilter");
+    }
+
+    if (!find_object("lib/Deque")) {
+	/*
+	 * message queues
+	 */
+	compile_object("lib/Deque");
+    }
+
+    if (!find_object("obj/message_shard")) {
+	/*
+	 * sharded message server
+	 */
+	compile_object("obj/message_shard");
+    }
+
+    if (!find_object("obj/online_shard")) {
+	/*
+	 * sharded online registry
+	 */
+	compile_object("obj/online_shard");
+    }
+
     destruct_object("sys/rest_api");
     compile_object("sys/rest_api");
 
+    /* pack accounts stored as objects */
+    ACCOUNT_SERVER->pack();
+
     return TRUE;
 }
+
+/*
+ * restored from a snapshot
+ */
+void reboot()
+{
+    if (previous_program() == SYS_INITD) {
+	MESSAGE_SERVER->reboot();
+    }
+}
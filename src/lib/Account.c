@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024-2025 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -17,6 +17,7 @@
  */
 
 # include "account.h"
+# include <type.h>
 
 
 # define DISCOVERABLE		0
@@ -24,6 +25,27 @@
 # define VIDEO			2
 # define VOICE			3
 
+/* packed record */
+# define ID			0
+# define DEVICES		1
+# define PHONE_NUMBER		2
+# define PNI			3
+# define PIN			4
+# define PNI_REGISTRATION_ID	5
+# define RECOVERY_PASSWORD	6
+# define REGISTRATION_LOCK	7
+# define SIGNALING_KEY		8
+# define UNIDENTIFIED_ACCESS_KEY 9
+# define IDENTITY_KEY		10
+# define PNI_KEY		11
+# define FLAGS			12
+# define RECORD_SIZE		13
+
+# define FLAG(bit)		((record()[FLAGS] >> (bit)) & 1)
+
+private mixed *record;		/* packed account, devices as packed records */
+
+/* before packing */
 private string id;
 private mapping devices;
 private string phoneNumber;
@@ -39,13 +61,61 @@ private string pniKey;
 private int flags;
 
 /*
- * initialize Account
+ * initialize Account, or a view on a packed account record
  */
-static void create(string phoneNumber, string pni, Device device)
+static void create(mixed phoneNumber, varargs string pni, Device device)
 {
-    ::phoneNumber = phoneNumber;
-    ::pni = pni;
-    devices = ([ device->id() : device ]);
+    if (typeof(phoneNumber) == T_ARRAY) {
+	record = phoneNumber;
+    } else {
+	record = allocate(RECORD_SIZE);
+	record[PHONE_NUMBER] = phoneNumber;
+	record[PNI] = pni;
+	record[DEVICES] = ([ device->id() : device->record() ]);
+    }
+}
+
+/*
+ * the account as a packed record, leaving an account stored before records
+ * were introduced unchanged
+ */
+mixed *packed()
+{
+    mapping records;
+    int *deviceIds, i;
+    Device *list;
+
+    if (record) {
+	return record;
+    }
+
+    records = ([ ]);
+    deviceIds = map_indices(devices);
+    list = map_values(devices);
+    for (i = sizeof(list); --i >= 0; ) {
+	records[deviceIds[i]] = list[i]->packed();
+    }
+    return ({
+	id, records, phoneNumber, pni, pin, pniRegistrationId,
+	recoveryPassword, registrationLock, signalingKey,
+	unidentifiedAccessKey, identityKey, pniKey, flags
+    });
+}
+
+/*
+ * the packed account record, packing an account stored before records were
+ * introduced
+ */
+mixed *record()
+{
+    if (!record) {
+	record = packed();
+	id = phoneNumber = pni = pin = recoveryPassword = registrationLock =
+	     signalingKey = unidentifiedAccessKey = identityKey = pniKey = nil;
+	devices = nil;
+	pniRegistrationId = flags = 0;
+    }
+    return record;
 }
 
 void update(int discoverable, string pin, int pniRegistrationId,
@@ -53,17 +123,20 @@ void update(int discoverable, string pin, int pniRegistrationId,
 	    string signalingKey, string unidentifiedAccessKey,
 	    int unrestrictedAccess, int video, int voice)
 {
-    ::pin = pin;
-    ::pniRegistrationId = pniRegistrationId;
-    ::recoveryPassword = recoveryPassword;
-    ::registrationLock = registrationLock;
-    ::signalingKey = signalingKey;
-    ::unidentifiedAccessKey = unidentifiedAccessKey;
+    int flags;
+
+    record()[PIN] = pin;
+    record()[PNI_REGISTRATION_ID] = pniRegistrationId;
+    record()[RECOVERY_PASSWORD] = recoveryPassword;
+    record()[REGISTRATION_LOCK] = registrationLock;
+    record()[SIGNALING_KEY] = signalingKey;
+    record()[UNIDENTIFIED_ACCESS_KEY] = unidentifiedAccessKey;
     flags = 0;
     flags |= discoverable <<		DISCOVERABLE;
     flags |= unrestrictedAccess <<	UNRESTRICTED_ACCESS;
     flags |= video <<			VIDEO;
     flags |= voice <<			VOICE;
+    record()[FLAGS] = flags;
 }
 
 /*
@@ -72,14 +145,16 @@ void update(int discoverable, string pin, int pniRegistrationId,
 void setId(string id)
 {
     if (previous_program() == ACCOUNT_SERVER) {
-	::id = id;
+	record()[ID] = id;
     }
 }
 
 int nextDeviceId()
 {
+    mapping devices;
     int max, id;
 
+    devices = record()[DEVICES];
     max = map_sizeof(devices) + 1;
     for (id = 1; id < max; id++) {
 	if (!devices[id]) {
@@ -91,50 +166,62 @@ int nextDeviceId()
 
 void addDevice(Device device)
 {
-    devices[device->id()] = device;
+    record()[DEVICES][device->id()] = device->record();
 }
 
 Device device(int deviceId)
 {
-    return devices[deviceId];
+    mixed *device;
+
+    device = record()[DEVICES][deviceId];
+    return (device) ? new Device(device) : nil;
 }
 
 Device *devices()
 {
-    return map_values(devices);
+    mixed **records;
+    Device *list;
+    int i;
+
+    records = map_values(record()[DEVICES]);
+    list = allocate(i = sizeof(records));
+    while (--i >= 0) {
+	list[i] = new Device(records[i]);
+    }
+    return list;
 }
 
 void updateIdentityKey(string key)
 {
     /*
-     * avoid object modification if possible
+     * avoid record modification if possible
      */
-    if (identityKey != key) {
-	identityKey = key;
+    if (record()[IDENTITY_KEY] != key) {
+	record()[IDENTITY_KEY] = key;
     }
 }
 
 void updatePniKey(string key)
 {
     /*
-     * avoid object modification if possible
+     * avoid record modification if possible
      */
-    if (pniKey != key) {
-	pniKey = key;
+    if (record()[PNI_KEY] != key) {
+	record()[PNI_KEY] = key;
     }
 }
 
 
-string id()			{ return id; }
-string phoneNumber()		{ return phoneNumber; }
-string pni()			{ return pni; }
-int discoverable()		{ return (flags >> DISCOVERABLE) & 1; }
-string pin()			{ return pin; }
-int pniRegistrationId()		{ return pniRegistrationId; }
-string registrationLock()	{ return registrationLock; }
-string unidentifiedAccessKey()	{ return unidentifiedAccessKey; }
-string identityKey()		{ return identityKey; }
-string pniKey()			{ return pniKey; }
-int unrestrictedAccess()	{ return (flags >> UNRESTRICTED_ACCESS) & 1; }
-int video()			{ return (flags >> VIDEO) & 1; }
-int voice()			{ return (flags >> VOICE) & 1; }
+string id()			{ return record()[ID]; }
+string phoneNumber()		{ return record()[PHONE_NUMBER]; }
+string pni()			{ return record()[PNI]; }
+int discoverable()		{ return FLAG(DISCOVERABLE); }
+string pin()			{ return record()[PIN]; }
+int pniRegistrationId()		{ return record()[PNI_REGISTRATION_ID]; }
+string registrationLock()	{ return record()[REGISTRATION_LOCK]; }
+string unidentifiedAccessKey()	{ return record()[UNIDENTIFIED_ACCESS_KEY]; }
+string identityKey()		{ return record()[IDENTITY_KEY]; }
+string pniKey()			{ return record()[PNI_KEY]; }
+int unrestrictedAccess()	{ return FLAG(UNRESTRICTED_ACCESS); }
+int video()			{ return FLAG(VIDEO); }
+int voice()			{ return FLAG(VOICE); }
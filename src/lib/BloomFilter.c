@@ -0,0 +1,120 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# define SEGMENT_BITS	15			/* log2 of segment size */
+# define SEGMENT_SIZE	(1 << SEGMENT_BITS)	/* counters per segment */
+# define SEGMENTS	128			/* 4M counters */
+# define COUNTERS	(SEGMENT_SIZE * SEGMENTS)
+# define HASHES		4			/* counters per key */
+# define SATURATED	255			/* sticky maximum */
+
+private string *segments;	/* byte counters */
+
+/*
+ * counting Bloom filter
+ */
+static void create()
+{
+    string segment;
+    int i;
+
+    segment = "\0\0\0\0\0\0\0\0";
+    while (strlen(segment) < SEGMENT_SIZE) {
+	segment += segment;
+    }
+    segments = allocate(SEGMENTS);
+    for (i = 0; i < SEGMENTS; i++) {
+	segments[i] = segment;
+    }
+}
+
+/*
+ * the counters for a key, 3 bytes of an MD5 hash each
+ */
+private int *counters(string key)
+{
+    string hash;
+    int *list, i, j;
+
+    hash = hash_string("MD5", key);
+    list = allocate(HASHES);
+    for (i = j = 0; i < HASHES; i++, j += 3) {
+	list[i] = ((hash[j] << 16) + (hash[j + 1] << 8) + hash[j + 2]) &
+		  (COUNTERS - 1);
+    }
+    return list;
+}
+
+/*
+ * add a key
+ */
+void add(string key)
+{
+    int *list, i, counter, offset;
+    string segment;
+
+    list = counters(key);
+    for (i = 0; i < HASHES; i++) {
+	counter = list[i];
+	segment = segments[counter >> SEGMENT_BITS];
+	offset = counter & (SEGMENT_SIZE - 1);
+	if (segment[offset] != SATURATED) {
+	    segment[offset] = segment[offset] + 1;
+	    segments[counter >> SEGMENT_BITS] = segment;
+	}
+    }
+}
+
+/*
+ * remove a key that was added before
+ */
+void remove(string key)
+{
+    int *list, i, counter, offset;
+    string segment;
+
+    list = counters(key);
+    for (i = 0; i < HASHES; i++) {
+	counter = list[i];
+	segment = segments[counter >> SEGMENT_BITS];
+	offset = counter & (SEGMENT_SIZE - 1);
+	if (segment[offset] != 0 && segment[offset] != SATURATED) {
+	    segment[offset] = segment[offset] - 1;
+	    segments[counter >> SEGMENT_BITS] = segment;
+	}
+    }
+}
+
+/*
+ * check whether a key may have been added; FALSE is always correct
+ */
+int contains(string key)
+{
+    int *list, i, counter;
+    string segment;
+
+    list = counters(key);
+    for (i = 0; i < HASHES; i++) {
+	counter = list[i];
+	segment = segments[counter >> SEGMENT_BITS];
+	if (segment[counter & (SEGMENT_SIZE - 1)] == 0) {
+	    return FALSE;
+	}
+    }
+    return TRUE;
+}
@@ -0,0 +1,229 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# define MIN_CHUNK	4	/* smallest chunk */
+# define MAX_CHUNK	1024	/* largest chunk */
+
+private mixed **chunks;		/* chunks of elements */
+private int head;		/* index of first element in first chunk */
+private int tail;		/* index after last element in last chunk */
+private int size;		/* number of elements */
+
+void pushMany(mixed *elements);
+
+/*
+ * double-ended queue, stored in chunks that grow with the size of the queue,
+ * so that neither adding nor removing elements requires copying the queue
+ */
+static void create(varargs mixed *elements)
+{
+    chunks = ({ });
+    if (elements) {
+	pushMany(elements);
+    }
+}
+
+/*
+ * add a new chunk at the end
+ */
+private void addChunk(int length)
+{
+    if (length < MIN_CHUNK) {
+	length = MIN_CHUNK;
+    } else if (length > MAX_CHUNK) {
+	length = MAX_CHUNK;
+    }
+    chunks += ({ allocate(length) });
+    tail = 0;
+}
+
+/*
+ * add an element at the end
+ */
+void push(mixed element)
+{
+    if (sizeof(chunks) == 0 || tail == sizeof(chunks[sizeof(chunks) - 1])) {
+	addChunk(size);
+    }
+    chunks[sizeof(chunks) - 1][tail++] = element;
+    size++;
+}
+
+/*
+ * add elements at the end
+ */
+void pushMany(mixed *elements)
+{
+    mixed *chunk;
+    int offset, sz, n, i;
+
+    sz = sizeof(elements);
+    while (offset < sz) {
+	if (sizeof(chunks) == 0 ||
+	    tail == sizeof(chunks[sizeof(chunks) - 1])) {
+	    addChunk((size > sz - offset) ? size : sz - offset);
+	}
+	chunk = chunks[sizeof(chunks) - 1];
+	n = sizeof(chunk) - tail;
+	if (n > sz - offset) {
+	    n = sz - offset;
+	}
+	for (i = 0; i < n; i++) {
+	    chunk[tail++] = elements[offset++];
+	}
+	size += n;
+    }
+}
+
+/*
+ * remove the first chunk
+ */
+private void removeChunk()
+{
+    chunks = chunks[1 ..];
+    head = 0;
+    if (sizeof(chunks) == 0) {
+	tail = 0;
+    }
+}
+
+/*
+ * the first element
+ */
+mixed front()
+{
+    return (size != 0) ? chunks[0][head] : nil;
+}
+
+/*
+ * remove and return the first element
+ */
+mixed pop()
+{
+    mixed element;
+
+    if (size == 0) {
+	return nil;
+    }
+    element = chunks[0][head];
+    chunks[0][head++] = nil;
+    --size;
+    if (head == sizeof(chunks[0]) || size == 0) {
+	removeChunk();
+    }
+    return element;
+}
+
+/*
+ * remove and return up to n elements from the front, or all elements if n
+ * is not given
+ */
+mixed *drain(varargs int n)
+{
+    mixed *elements, *chunk;
+    int offset, length, i;
+
+    if (n <= 0 || n > size) {
+	n = size;
+    }
+    elements = allocate(n);
+    while (offset < n) {
+	chunk = chunks[0];
+	length = ((sizeof(chunks) == 1) ? tail : sizeof(chunk)) - head;
+	if (length > n - offset) {
+	    length = n - offset;
+	}
+	for (i = 0; i < length; i++) {
+	    elements[offset++] = chunk[head];
+	    chunk[head++] = nil;
+	}
+	size -= length;
+	if (head == sizeof(chunk) || size == 0) {
+	    removeChunk();
+	}
+    }
+    return elements;
+}
+
+/*
+ * up to n elements from the front, or from a given position, without
+ * removing them
+ */
+mixed *peek(int n, varargs int from)
+{
+    mixed *elements, *chunk;
+    int offset, start, length, c, i;
+
+    if (from > size) {
+	from = size;
+    }
+    if (n > size - from) {
+	n = size - from;
+    }
+    elements = allocate(n);
+
+    /* skip whole chunks before the position */
+    start = head + from;
+    while (offset < n &&
+	   start >= (length = (c + 1 == sizeof(chunks)) ?
+				tail : sizeof(chunks[c]))) {
+	start -= length;
+	c++;
+    }
+    for (; offset < n; start = 0) {
+	chunk = chunks[c];
+	length = ((++c == sizeof(chunks)) ? tail : sizeof(chunk)) - start;
+	if (length > n - offset) {
+	    length = n - offset;
+	}
+	for (i = 0; i < length; i++) {
+	    elements[offset++] = chunk[start + i];
+	}
+    }
+    return elements;
+}
+
+/*
+ * all elements, in order, without removing them
+ */
+mixed *elements()
+{
+    mixed *elements;
+    int i, sz;
+
+    if (size == 0) {
+	return ({ });
+    }
+    sz = sizeof(chunks);
+    if (sz == 1) {
+	return chunks[0][head .. tail - 1];
+    }
+    elements = chunks[0][head ..];
+    for (i = 1; i < sz - 1; i++) {
+	elements += chunks[i];
+    }
+    return elements + chunks[sz - 1][.. tail - 1];
+}
+
+/*
+ * number of elements
+ */
+int size()
+{
+    return size;
+}
@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024-2025 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -17,8 +17,10 @@
  */
 
 # include "Timestamp.h"
+# include <type.h>
 
 private inherit "hash";
+private inherit "time";
 
 
 # define FETCHES_MESSAGES	0
@@ -32,6 +34,30 @@ private inherit "hash";
 # define STORIES		8
 # define UUID			9
 
+/* packed record */
+# define ID			0
+# define REGISTRATION_ID	1
+# define AUTH_TOKEN		2
+# define SALT			3
+# define NAME			4
+# define AGENT			5
+# define PK_ID			6
+# define PRE_KEY		7
+# define PK_SIGNATURE		8
+# define PNI_PK_ID		9
+# define PNI_PRE_KEY		10
+# define PNI_PK_SIGNATURE	11
+# define GCM_ID			12
+# define CAP			13
+# define CREATED		14
+# define LAST_SEEN		15
+# define RECORD_SIZE		16
+
+# define CAPABILITY(bit)		((record()[CAP] >> (bit)) & 1)
+
+private mixed *record;		/* packed device */
+
+/* before packing */
 private int id;
 private int registrationId;
 private string authToken;
@@ -49,29 +75,78 @@ private int cap;		/* capabilities */
 private Timestamp created;
 private Timestamp lastSeen;
 
+mixed *record();
+
+/*
+ * set the day the device was last seen; the record is only modified when the
+ * day changes, so that authentication normally leaves the account untouched
+ */
 void setLastSeen()
 {
-    if (!created) {
-	created = new Timestamp;
+    int day;
+
+    day = timeDay(time());
+    if (record()[LAST_SEEN] != day) {
+	record()[LAST_SEEN] = day;
     }
-    lastSeen = new Timestamp(time(), TRUE);
 }
 
 /*
- * initialize device
+ * initialize device, or a view on a packed device record
  */
-static void create(int id, string password)
+static void create(mixed id, varargs string password)
 {
-    ::id = id;
-    ({ authToken, salt }) = hash(password);
-    setLastSeen();
+    string *hashed;
+
+    if (typeof(id) == T_ARRAY) {
+	record = id;
+    } else {
+	record = allocate(RECORD_SIZE);
+	record[ID] = id;
+	hashed = hash(password);
+	record[AUTH_TOKEN] = hashed[0];
+	record[SALT] = hashed[1];
+	record[CREATED] = time();
+	setLastSeen();
+    }
+}
+
+/*
+ * the device as a packed record, leaving a device stored before records were
+ * introduced unchanged
+ */
+mixed *packed()
+{
+    return (record) ? record : ({
+	id, registrationId, authToken, salt, name, agent, pkId, preKey,
+	pkSignature, pniPkId, pniPreKey, pniPkSignature, gcmId, cap,
+	(created) ? created->time() : 0, (lastSeen) ? lastSeen->time() : 0
+    });
+}
+
+/*
+ * the packed device record, packing a device stored before records were
+ * introduced
+ */
+mixed *record()
+{
+    if (!record) {
+	record = packed();
+	id = registrationId = pkId = pniPkId = cap = 0;
+	authToken = salt = name = agent = preKey = pkSignature = pniPreKey =
+		    pniPkSignature = gcmId = nil;
+	created = lastSeen = nil;
+    }
+    return record;
 }
 
 void updateCapabilities(int announcementGroup, int changeNumber, int giftBadges,
 			int paymentActivation, int pni, int senderKey,
 			int storage, int stories, int uuid)
 {
-    cap &= TRUE <<		FETCHES_MESSAGES;
+    int cap;
+
+    cap = record()[CAP] & (TRUE << FETCHES_MESSAGES);
     cap |= announcementGroup <<	ANNOUNCEMENT_GROUP;
     cap |= changeNumber <<	CHANGE_NUMBER;
     cap |= giftBadges <<	GIFT_BADGES;
@@ -81,6 +156,7 @@ void updateCapabilities(int announcementGroup, int changeNumber, int giftBadges,
     cap |= storage <<		STORAGE;
     cap |= stories <<		STORIES;
     cap |= uuid <<		UUID;
+    record()[CAP] = cap;
 }
 
 void update(string name, int registrationId, string agent, int fetchesMessages,
@@ -88,10 +164,10 @@ void update(string name, int registrationId, string agent, int fetchesMessages,
 	    int capPaymentActivation, int capPni, int capSenderKey,
 	    int capStorage, int capStories, int capUuid)
 {
-    ::name = name;
-    ::registrationId = registrationId;
-    ::agent = agent;
-    cap = fetchesMessages << FETCHES_MESSAGES;
+    record()[NAME] = name;
+    record()[REGISTRATION_ID] = registrationId;
+    record()[AGENT] = agent;
+    record()[CAP] = fetchesMessages << FETCHES_MESSAGES;
     updateCapabilities(capAnnouncementGroup, capChangeNumber, capGiftBadges,
 		       capPaymentActivation, capPni, capSenderKey, capStorage,
 		       capStories, capUuid);
@@ -100,82 +176,96 @@ void update(string name, int registrationId, string agent, int fetchesMessages,
 int verifyPassword(string password)
 {
     setLastSeen();
-    return (authToken == hash(password, salt)[0]);
+    return (record()[AUTH_TOKEN] == hash(password, record()[SALT])[0]);
 }
 
 void setRegistrationId(int registrationId)
 {
-    ::registrationId = registrationId;
+    record()[REGISTRATION_ID] = registrationId;
 }
 
 void setFetchesMessages(int fetchesMessages)
 {
-    cap = cap & ~(1 << FETCHES_MESSAGES) |
-	  (fetchesMessages << FETCHES_MESSAGES);
+    record()[CAP] = record()[CAP] & ~(1 << FETCHES_MESSAGES) |
+		  (fetchesMessages << FETCHES_MESSAGES);
 }
 
 void setGcmId(string gcmId)
 {
-    ::gcmId = gcmId;
+    record()[GCM_ID] = gcmId;
 }
 
 void updateSignedPreKey(int keyId, string key, string signature)
 {
     /*
-     * avoid object modification if possible
+     * avoid record modification if possible
      */
-    if (pkId != keyId) {
-	pkId = keyId;
+    if (record()[PK_ID] != keyId) {
+	record()[PK_ID] = keyId;
     }
-    if (preKey != key) {
-	preKey = key;
+    if (record()[PRE_KEY] != key) {
+	record()[PRE_KEY] = key;
     }
-    if (pkSignature != signature) {
-	pkSignature = signature;
+    if (record()[PK_SIGNATURE] != signature) {
+	record()[PK_SIGNATURE] = signature;
     }
 }
 
 void updateSignedPniPreKey(int keyId, string key, string signature)
 {
     /*
-     * avoid object modification if possible
+     * avoid record modification if possible
      */
-    if (pniPkId != keyId) {
-	pniPkId = keyId;
+    if (record()[PNI_PK_ID] != keyId) {
+	record()[PNI_PK_ID] = keyId;
     }
-    if (pniPreKey != key) {
-	pniPreKey = key;
+    if (record()[PNI_PRE_KEY] != key) {
+	record()[PNI_PRE_KEY] = key;
     }
-    if (pniPkSignature != signature) {
-	pniPkSignature = signature;
+    if (record()[PNI_PK_SIGNATURE] != signature) {
+	record()[PNI_PK_SIGNATURE] = signature;
     }
 }
 
 mixed *signedPreKey()
 {
-    return ({ pkId, preKey, pkSignature });
+    return record()[PK_ID .. PK_SIGNATURE];
 }
 
 mixed *signedPniPreKey()
 {
-    return ({ pniPkId, pniPreKey, pniPkSignature });
-}
-
-
-int id()			{ return id; }
-int registrationId()		{ return registrationId; }
-string *authTokenHash()		{ return ({ authToken, salt }); }
-string name()			{ return name; }
-string gcmId()			{ return gcmId; }
-int fetchesMessages()		{ return (cap >> FETCHES_MESSAGES) & 1; }
-int capAnnouncementGroup()	{ return (cap >> ANNOUNCEMENT_GROUP) & 1; }
-int capChangeNumber()		{ return (cap >> CHANGE_NUMBER) & 1; }
-int capGiftBadges()		{ return (cap >> GIFT_BADGES) & 1; }
-int capPaymentActivation()	{ return (cap >> PAYMENT_ACTIVATION) & 1; }
-int capPni()			{ return (cap >> PNI) & 1; }
-int capSenderKey()		{ return (cap >> SENDER_KEY) & 1; }
-int capStorage()		{ return (cap >> STORAGE) & 1; }
-int capStories()		{ return (cap >> STORIES) & 1; }
-int capUuid()			{ return (cap >> UUID) & 1; }
-Timestamp created()		{ return created; }
-Timestamp lastSeen()		{ return lastSeen; }
+    return record()[PNI_PK_ID .. PNI_PK_SIGNATURE];
+}
+
+/*
+ * creation time, decoded on demand
+ */
+Timestamp created()
+{
+    return new Timestamp((string) record()[CREATED] + "000");
+}
+
+/*
+ * last seen day, decoded on demand
+ */
+Timestamp lastSeen()
+{
+    return new Timestamp(record()[LAST_SEEN], TRUE);
+}
+
+
+int id()			{ return record()[ID]; }
+int registrationId()		{ return record()[REGISTRATION_ID]; }
+string *authTokenHash()		{ return record()[AUTH_TOKEN .. SALT]; }
+string name()			{ return record()[NAME]; }
+string gcmId()			{ return record()[GCM_ID]; }
+int fetchesMessages()		{ return CAPABILITY(FETCHES_MESSAGES); }
+int capAnnouncementGroup()	{ return CAPABILITY(ANNOUNCEMENT_GROUP); }
+int capChangeNumber()		{ return CAPABILITY(CHANGE_NUMBER); }
+int capGiftBadges()		{ return CAPABILITY(GIFT_BADGES); }
+int capPaymentActivation()	{ return CAPABILITY(PAYMENT_ACTIVATION); }
+int capPni()			{ return CAPABILITY(PNI); }
+int capSenderKey()		{ return CAPABILITY(SENDER_KEY); }
+int capStorage()		{ return CAPABILITY(STORAGE); }
+int capStories()		{ return CAPABILITY(STORIES); }
+int capUuid()			{ return CAPABILITY(UUID); }
@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024-2025 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -18,12 +18,16 @@
 
 # include <String.h>
 # include "Timestamp.h"
+# include <type.h>
 
 private inherit "/lib/util/random";
 private inherit "~/lib/proto";
 private inherit uuid "~/lib/uuid";
+private inherit base64 "/lib/util/base64";
 
 
+# define FIXED_SIZE	96	/* IDs and timestamps */
+
 private object origin;			/* origin endpoint */
 private int type;			/* content type */
 private Timestamp timestamp;		/* content timestamp */
@@ -35,14 +39,78 @@ private string sourceId;		/* source account ID */
 private string destinationId;		/* destination account ID */
 private int destinationDeviceId;	/* destination device ID */
 private int urgent;			/* urgent? */
+private string header;			/* recipient-specific content prefix */
+private int ephemeral;			/* online only, never stored */
+private string wireHead;		/* wire form before the content */
+private string wireTail;		/* wire form after the content */
+
+/*
+ * encode the parts of the wire form that surround the content, once
+ */
+private void encode()
+{
+    string str;
+
+    str = "\010" + protoInt(type) +
+	  "\050" + protoAsnTime(timestamp->time(), timestamp->mtime());
+    if (sourceId) {
+	str += "\070" + protoInt(sourceDeviceId);
+    }
+    wireHead = str;
+
+    str = "\112" + protoString(uuid::encode(guid)) +
+	  "\120" + protoAsnTime(serverTimestamp->time(),
+				 serverTimestamp->mtime());
+    if (sourceId) {
+	str += "\132" + protoString(uuid::encode(sourceId));
+    }
+    wireTail = str + "\152" + protoString(uuid::encode(destinationId)) +
+	       "\160" + protoInt(urgent);
+}
 
 /*
- * create message envelope
+ * restore a saved envelope
  */
-static void create(object origin, string sourceId, int sourceDeviceId, int type,
-		   String content, Timestamp timestamp, string destinationId,
-		   int destinationDeviceId, int urgent)
+private void restore(string saved)
 {
+    StringBuffer chunk;
+    string buf, str;
+    int offset;
+
+    chunk = new StringBuffer;
+    ({ type, buf, offset }) = parseInt(chunk, saved, 0);
+    ({ str, buf, offset }) = parseString(chunk, buf, offset);
+    timestamp = new Timestamp(str);
+    ({ sourceDeviceId, buf, offset }) = parseInt(chunk, buf, offset);
+    ({ str, buf, offset }) = parseString(chunk, buf, offset);
+    content = (str != "") ? new String(str) : nil;
+    ({ guid, buf, offset }) = parseString(chunk, buf, offset);
+    ({ str, buf, offset }) = parseString(chunk, buf, offset);
+    serverTimestamp = new Timestamp(str);
+    ({ str, buf, offset }) = parseString(chunk, buf, offset);
+    sourceId = (str != "") ? str : nil;
+    ({ destinationId, buf, offset }) = parseString(chunk, buf, offset);
+    ({ destinationDeviceId, buf, offset }) = parseInt(chunk, buf, offset);
+    ({ urgent, buf, offset }) = parseInt(chunk, buf, offset);
+    ({ str, buf, offset }) = parseString(chunk, buf, offset);
+    header = (str != "") ? str : nil;
+    encode();
+}
+
+/*
+ * create message envelope; the content can be shared with other envelopes,
+ * each with its own header
+ */
+static void create(mixed origin, varargs string sourceId, int sourceDeviceId,
+		   int type, String content, Timestamp timestamp,
+		   string destinationId, int destinationDeviceId, int urgent,
+		   string header, int ephemeral)
+{
+    if (typeof(origin) == T_STRING) {
+	restore(origin);
+	return;
+    }
+
     ::type = type;
     ::timestamp = timestamp;
     ::origin = origin;
@@ -54,6 +122,9 @@ static void create(object origin, string sourceId, int sourceDeviceId, int type,
     ::destinationId = destinationId;
     ::destinationDeviceId = destinationDeviceId;
     ::urgent = urgent;
+    ::header = header;
+    ::ephemeral = ephemeral;
+    encode();
 }
 
 /*
@@ -63,31 +134,111 @@ StringBuffer transport()
 {
     StringBuffer buffer;
 
-    buffer = new StringBuffer("\010");
-    buffer->append(protoInt(type));
-    buffer->append("\050");
-    buffer->append(protoAsnTime(timestamp->time(), timestamp->mtime()));
-    buffer->append("\070");
-    buffer->append(protoInt(sourceDeviceId));
-    if (content) {
+    if (!wireHead) {
+	encode();	/* before wire caching */
+    }
+    buffer = new StringBuffer(wireHead);
+    if (header) {
+	buffer->append("\102");
+	buffer->append(protoInt(strlen(header) + content->buffer()->length()));
+	buffer->append(header);
+	buffer->append(content->buffer());
+    } else if (content) {
 	buffer->append("\102");
 	buffer->append(protoStrbuf(content->buffer()));
     }
-    buffer->append("\112");
-    buffer->append(protoString(uuid::encode(guid)));
-    buffer->append("\120");
-    buffer->append(protoAsnTime(serverTimestamp->time(),
-				serverTimestamp->mtime()));
-    buffer->append("\132");
-    buffer->append(protoString(uuid::encode(sourceId)));
-    buffer->append("\152");
-    buffer->append(protoString(uuid::encode(destinationId)));
-    buffer->append("\160");
-    buffer->append(protoInt(urgent));
+    buffer->append(wireTail);
 
     return buffer;
 }
 
+/*
+ * content as a string
+ */
+private string contentString()
+{
+    StringBuffer buffer;
+    string str, chunk;
+
+    str = "";
+    if (content) {
+	buffer = new StringBuffer;
+	buffer->append(content->buffer());
+	while ((chunk=buffer->chunk())) {
+	    str += chunk;
+	}
+    }
+    return str;
+}
+
+/*
+ * export envelope as a JSON message entity
+ */
+mapping entity()
+{
+    mapping entity;
+
+    entity = ([
+	"guid" : uuid::encode(guid),
+	"type" : type,
+	"timestamp" : timestamp,
+	"destinationUuid" : uuid::encode(destinationId),
+	"serverTimestamp" : serverTimestamp,
+	"urgent" : urgent,
+	"story" : FALSE
+    ]);
+    if (sourceId) {
+	entity["sourceUuid"] = uuid::encode(sourceId);
+	entity["sourceDevice"] = sourceDeviceId;
+    }
+    if (header || content) {
+	entity["content"] = base64::encode(((header) ? header : "") +
+					   contentString());
+    }
+    return entity;
+}
+
+/*
+ * save envelope as a string, without origin
+ */
+string save()
+{
+    string str;
+
+    str = contentString();
+    return protoInt(type) +
+	   protoString(timestamp->transport()) +
+	   protoInt(sourceDeviceId) +
+	   protoString(str) +
+	   protoString(guid) +
+	   protoString(serverTimestamp->transport()) +
+	   protoString((sourceId) ? sourceId : "") +
+	   protoString(destinationId) +
+	   protoInt(destinationDeviceId) +
+	   protoInt(urgent) +
+	   protoString((header) ? header : "");
+}
+
+/*
+ * approximate size of the envelope
+ */
+int size()
+{
+    int size;
+
+    size = FIXED_SIZE;
+    if (wireHead) {
+	size += strlen(wireHead) + strlen(wireTail);
+    }
+    if (header) {
+	size += strlen(header);
+    }
+    if (content) {
+	size += content->buffer()->length();
+    }
+    return size;
+}
+
 
 int type()			{ return type; }
 object origin()			{ return origin; }
@@ -100,3 +251,4 @@ Timestamp serverTimestamp()	{ return serverTimestamp; }
 string destinationId()		{ return destinationId; }
 int destinationDeviceId()	{ return destinationDeviceId; }
 int urgent()			{ return urgent; }
+int ephemeral()			{ return ephemeral; }
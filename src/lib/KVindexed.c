@@ -0,0 +1,291 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# define ENTRIES	0	/* index entries */
+# define BYTES		1	/* bytes used by index keys and values */
+
+private object owner;		/* object that derives index keys */
+private object store;		/* key : value */
+private mapping indexes;	/* name : index store */
+private mapping derive;		/* name : function that derives the index key */
+private mapping usage;		/* name : ({ entries, bytes }) */
+
+/*
+ * K/V store with secondary indexes ([ name : ({ index store, function }) ]),
+ * where the function is called in the owner to derive the index key from a
+ * value; the stores may already hold data
+ */
+static void create(object owner, object primary, mapping secondary)
+{
+    string *names;
+    int i;
+
+    ::owner = owner;
+    store = primary;
+    indexes = ([ ]);
+    derive = ([ ]);
+    usage = ([ ]);
+    for (names = map_indices(secondary), i = sizeof(names); --i >= 0; ) {
+	indexes[names[i]] = secondary[names[i]][0];
+	derive[names[i]] = secondary[names[i]][1];
+	usage[names[i]] = ({ 0, 0 });
+    }
+}
+
+/*
+ * index keys for a value: ({ ({ name, indexKey }) })
+ */
+private mixed **indexKeys(mixed value)
+{
+    string *names;
+    mixed **keys;
+    int i;
+
+    names = map_indices(derive);
+    keys = allocate(i = sizeof(names));
+    while (--i >= 0) {
+	keys[i] = ({ names[i], call_other(owner, derive[names[i]], value) });
+    }
+    return keys;
+}
+
+/*
+ * add an index entry, which fails if the index key is already in use
+ */
+private void addEntry(string name, string indexKey, string key)
+{
+    int *stats;
+
+    indexes[name]->add(indexKey, key);
+    stats = usage[name];
+    stats[ENTRIES]++;
+    stats[BYTES] += strlen(indexKey) + strlen(key);
+}
+
+/*
+ * set an index entry, replacing an entry that may still be present
+ */
+private void setEntry(string name, string indexKey, string key)
+{
+    object index;
+    string old;
+    int *stats;
+
+    index = indexes[name];
+    old = index[indexKey];
+    index[indexKey] = key;
+    stats = usage[name];
+    if (old) {
+	stats[BYTES] += strlen(key) - strlen(old);
+    } else {
+	stats[ENTRIES]++;
+	stats[BYTES] += strlen(indexKey) + strlen(key);
+    }
+}
+
+/*
+ * remove an index entry, if it refers to the given key
+ */
+private void removeEntry(string name, string indexKey, string key)
+{
+    object index;
+    int *stats;
+
+    index = indexes[name];
+    if (index[indexKey] == key) {
+	index[indexKey] = nil;
+	stats = usage[name];
+	if (stats[ENTRIES] != 0) {
+	    stats[ENTRIES]--;
+	    stats[BYTES] -= strlen(indexKey) + strlen(key);
+	}
+    }
+}
+
+/*
+ * add K/V with its index keys; fails without effect if the key or any of
+ * the index keys is already in use
+ */
+atomic void add(string key, mixed value)
+{
+    mixed **keys;
+    int i;
+
+    store->add(key, value);
+    for (keys = indexKeys(value), i = sizeof(keys); --i >= 0; ) {
+	if (keys[i][1]) {
+	    addEntry(keys[i][0], keys[i][1], key);
+	}
+    }
+}
+
+/*
+ * set K/V, replacing index entries that still refer to other keys
+ */
+atomic void set(string key, mixed value)
+{
+    mixed old, **keys;
+    int i;
+
+    old = store[key];
+    if (old != nil) {
+	for (keys = indexKeys(old), i = sizeof(keys); --i >= 0; ) {
+	    if (keys[i][1]) {
+		removeEntry(keys[i][0], keys[i][1], key);
+	    }
+	}
+    }
+    store[key] = value;
+    if (value != nil) {
+	for (keys = indexKeys(value), i = sizeof(keys); --i >= 0; ) {
+	    if (keys[i][1]) {
+		setEntry(keys[i][0], keys[i][1], key);
+	    }
+	}
+    }
+}
+
+/*
+ * add the index keys of an existing K/V
+ */
+atomic void index(string key)
+{
+    mixed value, **keys;
+    int i;
+
+    value = store[key];
+    if (value == nil) {
+	error("No such key");
+    }
+    for (keys = indexKeys(value), i = sizeof(keys); --i >= 0; ) {
+	if (keys[i][1]) {
+	    addEntry(keys[i][0], keys[i][1], key);
+	}
+    }
+}
+
+/*
+ * change the value of an existing K/V, leaving the indexes as they are
+ */
+void change(string key, mixed value)
+{
+    store->change(key, value);
+}
+
+/*
+ * remove K/V and its index keys
+ */
+void remove(string key)
+{
+    set(key, nil);
+}
+
+/*
+ * get value by key
+ */
+mixed get(string key)
+{
+    return store[key];
+}
+
+/*
+ * get multiple values by key
+ */
+mixed *getMany(string *keys)
+{
+    mixed *values;
+    int i;
+
+    values = allocate(i = sizeof(keys));
+    while (--i >= 0) {
+	values[i] = store[keys[i]];
+    }
+    return values;
+}
+
+/*
+ * look up key in an index
+ */
+string lookup(string name, string indexKey)
+{
+    return indexes[name][indexKey];
+}
+
+/*
+ * look up multiple keys in an index
+ */
+string *lookupMany(string name, string *indexKeys)
+{
+    object index;
+    string *keys;
+    int i;
+
+    index = indexes[name];
+    keys = allocate(i = sizeof(indexKeys));
+    while (--i >= 0) {
+	keys[i] = index[indexKeys[i]];
+    }
+    return keys;
+}
+
+/*
+ * get value by index key
+ */
+mixed getBy(string name, string indexKey)
+{
+    string key;
+
+    key = indexes[name][indexKey];
+    return (key) ? store[key] : nil;
+}
+
+/*
+ * get multiple values by index key
+ */
+mixed *getManyBy(string name, string *indexKeys)
+{
+    string *keys;
+    mixed *values;
+    int i;
+
+    keys = lookupMany(name, indexKeys);
+    values = allocate(i = sizeof(keys));
+    while (--i >= 0) {
+	if (keys[i]) {
+	    values[i] = store[keys[i]];
+	}
+    }
+    return values;
+}
+
+/*
+ * memory statistics per index: ([ name : ({ entries, bytes }) ]), counting
+ * only the entries added or removed through this object
+ */
+mapping statistics()
+{
+    string *names;
+    mapping result;
+    int i;
+
+    result = ([ ]);
+    for (names = map_indices(usage), i = sizeof(names); --i >= 0; ) {
+	result[names[i]] = usage[names[i]][..];
+    }
+    return result;
+}
@@ -0,0 +1,191 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# include <KVstore.h>
+
+
+# define PAGE_SIZE	256	/* maximum number of keys in a page */
+
+private object pages;		/* page ID : ({ sorted keys }) */
+private string *bounds;		/* lower bound of the keys in each page */
+private int *ids;		/* ID of each page */
+private int lastId;		/* last page ID used */
+
+/*
+ * ordered set of keys, divided over pages
+ */
+static void create()
+{
+    pages = new KVstore(199);
+    bounds = ({ });
+    ids = ({ });
+}
+
+/*
+ * find the page that holds, or would hold, a key
+ */
+private int findPage(string key)
+{
+    int low, high, mid;
+
+    low = 0;
+    high = sizeof(bounds);
+    while (low < high) {
+	mid = (low + high) >> 1;
+	if (bounds[mid] <= key) {
+	    low = mid + 1;
+	} else {
+	    high = mid;
+	}
+    }
+    return (low != 0) ? low - 1 : 0;
+}
+
+/*
+ * find the position of the first key in a page that is not less than key
+ */
+private int findKey(string *page, string key)
+{
+    int low, high, mid;
+
+    low = 0;
+    high = sizeof(page);
+    while (low < high) {
+	mid = (low + high) >> 1;
+	if (page[mid] < key) {
+	    low = mid + 1;
+	} else {
+	    high = mid;
+	}
+    }
+    return low;
+}
+
+/*
+ * add a key
+ */
+void insert(string key)
+{
+    int i, p, half;
+    string *page, pageId;
+
+    if (sizeof(ids) == 0) {
+	pages[(string) ++lastId] = ({ key });
+	bounds = ({ key });
+	ids = ({ lastId });
+	return;
+    }
+
+    i = findPage(key);
+    pageId = (string) ids[i];
+    page = pages[pageId];
+    p = findKey(page, key);
+    if (p < sizeof(page) && page[p] == key) {
+	return;		/* already present */
+    }
+    page = page[.. p - 1] + ({ key }) + page[p ..];
+
+    if (sizeof(page) > PAGE_SIZE) {
+	/*
+	 * split page
+	 */
+	half = sizeof(page) >> 1;
+	pages[pageId] = page[.. half - 1];
+	pages[(string) ++lastId] = page[half ..];
+	bounds = bounds[.. i] + ({ page[half] }) + bounds[i + 1 ..];
+	ids = ids[.. i] + ({ lastId }) + ids[i + 1 ..];
+    } else {
+	pages[pageId] = page;
+    }
+}
+
+/*
+ * remove a key
+ */
+void remove(string key)
+{
+    int i, p;
+    string *page, pageId;
+
+    if (sizeof(ids) == 0) {
+	return;
+    }
+
+    i = findPage(key);
+    pageId = (string) ids[i];
+    page = pages[pageId];
+    p = findKey(page, key);
+    if (p == sizeof(page) || page[p] != key) {
+	return;		/* not present */
+    }
+
+    if (sizeof(page) == 1) {
+	/*
+	 * remove empty page; its range is taken over by the previous one
+	 */
+	pages[pageId] = nil;
+	bounds = bounds[.. i - 1] + bounds[i + 1 ..];
+	ids = ids[.. i - 1] + ids[i + 1 ..];
+    } else {
+	pages[pageId] = page[.. p - 1] + page[p + 1 ..];
+    }
+}
+
+/*
+ * get at most n keys in order, starting from key from, and less than upper
+ */
+string *range(string from, int inclusive, int n, string upper)
+{
+    string *keys, *page, key;
+    int i, p, sz;
+
+    keys = ({ });
+    if (sizeof(ids) == 0 || n <= 0) {
+	return keys;
+    }
+
+    if (from) {
+	i = findPage(from);
+	page = pages[(string) ids[i]];
+	p = findKey(page, from);
+	if (!inclusive && p < sizeof(page) && page[p] == from) {
+	    p++;
+	}
+    } else {
+	page = pages[(string) ids[0]];
+    }
+
+    for (;;) {
+	for (sz = sizeof(page); p < sz; p++) {
+	    key = page[p];
+	    if (upper && key >= upper) {
+		return keys;
+	    }
+	    keys += ({ key });
+	    if (sizeof(keys) == n) {
+		return keys;
+	    }
+	}
+
+	if (++i == sizeof(ids)) {
+	    return keys;
+	}
+	page = pages[(string) ids[i]];
+	p = 0;
+    }
+}
@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -17,11 +17,20 @@
  */
 
 # include <KVstore.h>
+# include <type.h>
 
 inherit KVstore;
 
 
-private int duration;	/* K/V duration */
+# define SLOTS		256	/* expiry slots per duration */
+# define SLOT_MIN	60	/* minimum seconds per expiry slot */
+# define WHEELS		16	/* parts of the expiry index */
+# define KVWHEEL_EXP	"/usr/MsgServer/obj/kvwheel_exp"
+
+private int duration;		/* K/V duration */
+private object *wheels;		/* expiry index, divided by key */
+private int reclaimed;		/* reclaimed entries */
+private int reclaimedBytes;	/* reclaimed bytes, estimated */
 
 /*
  * KVstore with expiration
@@ -32,6 +41,78 @@ static void create(int maxSize, int duration)
     ::duration = duration;
 }
 
+/*
+ * estimate the size of a value
+ */
+private int valueSize(mixed value)
+{
+    int size, i;
+    mixed *values;
+
+    switch (typeof(value)) {
+    case T_STRING:
+	return strlen(value);
+
+    case T_OBJECT:
+	return (function_object("size", value)) ? value->size() : 0;
+
+    case T_ARRAY:
+	values = value;
+	break;
+
+    case T_MAPPING:
+	values = map_indices(value) + map_values(value);
+	break;
+
+    default:
+	return 0;
+    }
+
+    for (size = i = sizeof(values); --i >= 0; ) {
+	size += valueSize(values[i]);
+    }
+    return size;
+}
+
+/*
+ * the part of the expiry index for a key; the final byte of each key is
+ * evenly distributed
+ */
+private object wheel(string key)
+{
+    int granularity, i;
+
+    if (!wheels) {
+	granularity = duration / SLOTS;
+	if (granularity < SLOT_MIN) {
+	    granularity = SLOT_MIN;
+	}
+	wheels = allocate(WHEELS);
+	for (i = 0; i < WHEELS; i++) {
+	    wheels[i] = clone_object(KVWHEEL_EXP, granularity);
+	}
+    }
+    return wheels[key[strlen(key) - 1] % WHEELS];
+}
+
+/*
+ * add a key to the expiry index
+ */
+private void index(string key, int expiration, mixed value)
+{
+    wheel(key)->index(key, expiration, valueSize(value));
+}
+
+/*
+ * remove a key from the expiry index
+ */
+private void unindex(string key, int expiration)
+{
+    if (wheels) {
+	wheel(key)->unindex(key, expiration);
+    }
+}
+
 /*
  * get K/V
  */
@@ -43,6 +124,25 @@ mixed get(string key)
     return (value) ? value[1] : nil;
 }
 
+/*
+ * get multiple K/Vs with a single call to the store; each key is still
+ * looked up by itself
+ */
+mixed *getMany(string *keys)
+{
+    mixed *values, value;
+    int i;
+
+    values = allocate(i = sizeof(keys));
+    while (--i >= 0) {
+	value = ::get(keys[i]);
+	if (value) {
+	    values[i] = value[1];
+	}
+    }
+    return values;
+}
+
 /*
  * get duration
  */
@@ -59,7 +159,20 @@ int getDuration(string key)
  */
 void set(string key, mixed value)
 {
-    ::set(key, ({ time() + duration, value }));
+    mixed old;
+    int expiration;
+
+    old = ::get(key);
+    if (old) {
+	unindex(key, old[0]);
+    }
+    if (value == nil) {
+	::set(key, nil);
+    } else {
+	expiration = time() + duration;
+	::set(key, ({ expiration, value }));
+	index(key, expiration, value);
+    }
 }
 
 /*
@@ -67,7 +180,11 @@ void set(string key, mixed value)
  */
 void add(string key, mixed value)
 {
-    ::add(key, ({ time() + duration, value }));
+    int expiration;
+
+    expiration = time() + duration;
+    ::add(key, ({ expiration, value }));
+    index(key, expiration, value);
 }
 
 /*
@@ -75,5 +192,52 @@ void add(string key, mixed value)
  */
 void change(string key, mixed value)
 {
-    ::change(key, ({ time() + duration, value }));
+    mixed old;
+    int expiration;
+
+    old = ::get(key);
+    expiration = time() + duration;
+    ::change(key, ({ expiration, value }));
+    if (old) {
+	unindex(key, old[0]);
+    }
+    index(key, expiration, value);
+}
+
+/*
+ * remove expired keys, at most budget at a time; return TRUE if there is
+ * more to do
+ */
+int sweep(int budget)
+{
+    int more, i, j;
+    string *keys;
+    int *sizes;
+
+    if (!wheels) {
+	return FALSE;
+    }
+
+    for (i = 0; i < WHEELS && budget > 0; i++) {
+	({ keys, sizes, more }) = wheels[i]->due(budget);
+	for (j = sizeof(keys); --j >= 0; ) {
+	    if (!::get(keys[j])) {
+		/* expired, or removed already */
+		::set(keys[j], nil);
+		reclaimed++;
+		reclaimedBytes += sizes[j];
+	    }
+	}
+	budget -= sizeof(keys);
+    }
+
+    return (more || i < WHEELS);
+}
+
+/*
+ * sweep statistics: ({ reclaimed entries, reclaimed bytes })
+ */
+int *sweepStatus()
+{
+    return ({ reclaimed, reclaimedBytes });
 }
@@ -0,0 +1,92 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# include <KVstore.h>
+# include "KVstoreOrd.h"
+
+inherit KVstore;
+
+
+private KVkeys keys;	/* ordered keys */
+
+/*
+ * KVstore that can be walked in key order
+ */
+static void create(int maxSize)
+{
+    ::create(maxSize);
+    keys = new KVkeys();
+}
+
+/*
+ * set K/V
+ */
+void set(string key, mixed value)
+{
+    ::set(key, value);
+    if (value == nil) {
+	keys->remove(key);
+    } else {
+	keys->insert(key);
+    }
+}
+
+/*
+ * add K/V
+ */
+void add(string key, mixed value)
+{
+    ::add(key, value);
+    keys->insert(key);
+}
+
+/*
+ * create a cursor for the keys from lower up to but not including upper;
+ * either bound can be nil
+ */
+mixed *first(varargs string lower, string upper)
+{
+    return ({ lower, TRUE, upper });
+}
+
+/*
+ * get at most n keys and values from a cursor: ({ keys, values, cursor }),
+ * where the new cursor is nil when there are no more keys
+ */
+mixed *next(mixed *cursor, int n)
+{
+    string *list;
+    mixed *values;
+    int i;
+
+    if (!cursor) {
+	return ({ ({ }), ({ }), nil });
+    }
+
+    list = keys->range(cursor[0], cursor[1], n, cursor[2]);
+    values = allocate(i = sizeof(list));
+    while (--i >= 0) {
+	values[i] = get(list[i]);
+    }
+
+    return ({
+	list,
+	values,
+	(sizeof(list) == n) ? ({ list[n - 1], FALSE, cursor[2] }) : nil
+    });
+}
@@ -0,0 +1,241 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# include <status.h>
+
+
+# define JOURNAL_DIR		"~/journal"
+# define COMMIT_DELAY		0.05	/* seconds to collect records */
+# define ROTATE_INTERVAL	86400	/* seconds per generation */
+# define JOURNAL_KEEP		30	/* generations kept, as stored envelopes */
+# define REPLAY_CHUNK		65536	/* bytes to replay per task */
+# define HEADER			5	/* record type and length */
+
+/*
+ * An append-only journal of records, to recover what changed since the last
+ * snapshot after a crash.  Records are collected and written together in a
+ * single task, since files cannot be written from atomic functions.  A new
+ * journal generation is started every day.  Generations are only removed
+ * once they precede the position recorded in the snapshot that was last
+ * restored, which later snapshots cannot precede, or once they are older
+ * than anything journalled can live.  After a restore, the journal is
+ * replayed in the background; inheritors hold back reads until that is done.
+ */
+
+private string *pending;	/* records not yet written */
+private int committing;		/* commit scheduled */
+private int generation;		/* current generation */
+private int retained;		/* first generation a snapshot may need */
+private int written;		/* bytes written in current generation */
+private int started;		/* start time of run that wrote the journal */
+private int replaying;		/* replay in progress */
+private int records;		/* records written */
+private int replayed;		/* records replayed */
+
+static void replayRecord(int type, string payload);
+static void journalCommitted();
+
+/*
+ * journal file for a generation
+ */
+private string journalFile(int gen)
+{
+    int number;
+
+    sscanf(object_name(this_object()), "%*s#%d", number);
+    return JOURNAL_DIR + "/" + number + "." + gen;
+}
+
+/*
+ * size of a journal file
+ */
+private int fileSize(string file)
+{
+    mixed **info;
+
+    info = get_dir(file);
+    return (sizeof(info[1]) != 0 && info[1][0] > 0) ? info[1][0] : 0;
+}
+
+/*
+ * start a new generation, and remove generations that no snapshot needs
+ */
+private void rotate(int gen)
+{
+    string *files;
+    int number, old, i;
+
+    if (sizeof(get_dir(JOURNAL_DIR)[0]) == 0) {
+	make_dir(JOURNAL_DIR);
+    }
+    sscanf(object_name(this_object()), "%*s#%d", number);
+    files = get_dir(JOURNAL_DIR + "/" + number + ".*")[0];
+    for (i = sizeof(files); --i >= 0; ) {
+	if (sscanf(files[i], "%*d.%d", old) == 2 &&
+	    (old < retained || old <= gen - JOURNAL_KEEP)) {
+	    remove_file(JOURNAL_DIR + "/" + files[i]);
+	}
+    }
+
+    generation = gen;
+    written = 0;
+}
+
+/*
+ * check whether the server was restarted since the journal was last written;
+ * if so, replay what was written after the snapshot, and continue writing
+ * at the end of the journal
+ */
+static void journalCheck()
+{
+    int start, gen, size;
+
+    start = status(ST_STARTTIME);
+    if (start != started) {
+	if (started != 0 && generation != 0 && !replaying) {
+	    /* the snapshot recorded its position in the journal */
+	    retained = generation;
+	    gen = time() / ROTATE_INTERVAL;
+	    size = fileSize(journalFile(gen));
+	    replaying = TRUE;
+	    call_out("replay", 0, generation, written, gen, size);
+	    generation = gen;
+	    written = size;
+	}
+	started = start;
+    }
+}
+
+/*
+ * add a record to the journal
+ */
+static void journal(int type, string payload)
+{
+    string header;
+    int length;
+
+    journalCheck();
+
+    length = strlen(payload);
+    header = "\0\0\0\0\0";
+    header[0] = type;
+    header[1] = length >> 24;
+    header[2] = length >> 16;
+    header[3] = length >> 8;
+    header[4] = length;
+    if (!pending) {
+	pending = ({ });
+    }
+    pending += ({ header + payload });
+
+    if (!committing) {
+	committing = TRUE;
+	call_out("commit", COMMIT_DELAY);
+    }
+}
+
+/*
+ * write all pending records at once
+ */
+static void commit()
+{
+    string str;
+    int gen;
+
+    committing = FALSE;
+    journalCheck();
+
+    gen = time() / ROTATE_INTERVAL;
+    if (gen != generation) {
+	rotate(gen);
+    }
+
+    str = implode(pending, "");
+    if (!write_file(journalFile(generation), str, written)) {
+	error("Cannot write journal");
+    }
+    written += strlen(str);
+    records += sizeof(pending);
+    pending = ({ });
+    journalCommitted();
+}
+
+/*
+ * replay the journal from a given position, one chunk per task
+ */
+static void replay(int gen, int offset, int endGen, int endOffset)
+{
+    string file, buf, str;
+    int end, length, i;
+
+    try {
+	file = journalFile(gen);
+	end = (gen == endGen) ? endOffset : fileSize(file);
+	if (offset + HEADER <= end) {
+	    buf = read_file(file, offset, (end - offset > REPLAY_CHUNK) ?
+					    REPLAY_CHUNK : end - offset);
+	    for (i = 0; i + HEADER <= strlen(buf); i += HEADER + length) {
+		/* a record that cannot be replayed is skipped */
+		length = (buf[i + 1] << 24) | (buf[i + 2] << 16) |
+			 (buf[i + 3] << 8) | buf[i + 4];
+		if (offset + i + HEADER + length > end) {
+		    /* incomplete final record */
+		    i = end - offset;
+		    break;
+		}
+		if (i + HEADER + length > strlen(buf)) {
+		    if (i != 0) {
+			break;
+		    }
+
+		    /* record larger than a chunk */
+		    buf = read_file(file, offset, HEADER + length);
+		}
+		str = buf[i + HEADER .. i + HEADER + length - 1];
+		if (!catch(replayRecord(buf[i], str))) {
+		    replayed++;
+		}
+	    }
+
+	    call_out("replay", 0, gen, offset + i, endGen, endOffset);
+	} else if (gen < endGen) {
+	    call_out("replay", 0, gen + 1, 0, endGen, endOffset);
+	} else {
+	    replaying = FALSE;
+	}
+    } catch (...) {
+	/* give up, rather than hold back delivery forever */
+	replaying = FALSE;
+    }
+}
+
+/*
+ * is the journal being replayed?
+ */
+static int journalReplaying()
+{
+    return replaying;
+}
+
+/*
+ * journal status: ({ records written, records replayed })
+ */
+int *journalStatus()
+{
+    return ({ records, replayed });
+}
@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024-2025 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -25,6 +25,7 @@
 # include "rest.h"
 # include "account.h"
 # include "credentials.h"
+# include "Deque.h"
 # include "~/config/services"
 # include <config.h>
 # include <version.h>
@@ -45,6 +46,15 @@ private mixed *handle;		/* call handle */
 private string login, password;	/* websocket authentication */
 private string websocket;	/* WebSocket service */
 private int opcode, flags;	/* opcode and flags of last WebSocket frame */
+private Deque outbound;		/* sizes of WebSocket chunks being sent */
+private int outboundBytes;	/* bytes in WebSocket chunks being sent */
+private int sent;		/* WebSocket chunks sent */
+private int congestion;		/* outbound above the high watermark */
+
+# define OUT_HIGH_BYTES		262144	/* hold back above this many bytes */
+# define OUT_HIGH_CHUNKS	64	/* hold back above this many chunks */
+# define OUT_LIMIT_BYTES	4194304	/* close above this many bytes */
+# define OUT_LIMIT_CHUNKS	1024	/* close above this many chunks */
 
 /*
  * establish connection
@@ -57,16 +67,58 @@ void init(object connection)
 }
 
 /*
- * send a StringBuffer chunk via WebSocket
+ * send a StringBuffer chunk via WebSocket; a client that stops receiving is
+ * disconnected
  */
 static void sendChunk(StringBuffer chunk)
 {
+    int length;
+
     if (!websocket) {
 	error("Not a WebSocket connection");
     }
+    if (!outbound) {
+	outbound = new Deque();
+    }
+    length = chunk->length();
+    if (outboundBytes + length > OUT_LIMIT_BYTES ||
+	outbound->size() >= OUT_LIMIT_CHUNKS) {
+	connection->terminate();
+	return;
+    }
+    outbound->push(length);
+    outboundBytes += length;
+    sent++;
+    if (outboundBytes >= OUT_HIGH_BYTES ||
+	outbound->size() >= OUT_HIGH_CHUNKS) {
+	congestion = TRUE;
+    }
     ::wsSendChunk(connection, chunk);
 }
 
+/*
+ * is outbound WebSocket traffic above the high watermark?
+ */
+static int congested()
+{
+    return congestion;
+}
+
+/*
+ * outbound WebSocket traffic dropped below the low watermark
+ */
+static void uncongested()
+{
+}
+
+/*
+ * outbound WebSocket traffic: ({ bytes being sent, chunks being sent })
+ */
+int *outboundStatus()
+{
+    return ({ outboundBytes, (outbound) ? outbound->size() : 0 });
+}
+
 /*
  * close WebSocket connection
  */
@@ -147,7 +199,7 @@ static int respond(string context, int code, string type, StringBuffer entity,
 /*
  * respond with JSON body
  */
-static int respondJson(string context, int code, mapping entity,
+static int respondJson(string context, int code, mixed entity,
 		       varargs mapping extraHeaders)
 {
     return respond(context, code, "application/json;charset=utf-8",
@@ -504,11 +556,23 @@ void receiveWsChunk(StringBuffer chunk)
 }
 
 /*
- * finished sending response
+ * finished sending response; the output buffer of the connection was empty,
+ * so all chunks sent before the notification are no longer outbound
  */
-static void _doneChunk(object prev)
+static void _doneChunk(object prev, int flushed)
 {
     if (prev == connection) {
+	if (websocket && outbound && outbound->size() > sent - flushed) {
+	    do {
+		outboundBytes -= outbound->pop();
+	    } while (outbound->size() > sent - flushed);
+	    if (congestion && outboundBytes < OUT_HIGH_BYTES / 2 &&
+		outbound->size() < OUT_HIGH_CHUNKS / 2) {
+		congestion = FALSE;
+		uncongested();
+	    }
+	}
+
 	if (!websocket) {
 	    connection->doneRequest();
 	} else if (opcode == WEBSOCK_CLOSE) {
@@ -522,7 +586,7 @@ static void _doneChunk(object prev)
  */
 void doneChunk()
 {
-    call_out("_doneChunk", 0, previous_object());
+    call_out("_doneChunk", 0, previous_object(), sent);
 }
 
 /*
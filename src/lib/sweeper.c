@@ -0,0 +1,74 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# define SWEEP_INTERVAL	60	/* seconds between sweeps */
+# define SWEEP_BUDGET	500	/* keys to sweep per store per task */
+
+
+private int sweeping;		/* sweeper started */
+
+static object *expiringStores();
+
+/*
+ * start sweeping expired keys, if not done so already
+ */
+static void startSweeper()
+{
+    if (!sweeping) {
+	sweeping = TRUE;
+	call_out("sweep", SWEEP_INTERVAL);
+    }
+}
+
+/*
+ * remove expired keys in short tasks, so as not to interfere with other
+ * activity
+ */
+static void sweep()
+{
+    object *stores;
+    int more, i;
+
+    stores = expiringStores();
+    for (i = sizeof(stores); --i >= 0; ) {
+	if (stores[i]->sweep(SWEEP_BUDGET)) {
+	    more = TRUE;
+	}
+    }
+
+    call_out("sweep", (more) ? 0 : SWEEP_INTERVAL);
+}
+
+/*
+ * sweep statistics: ({ reclaimed entries, reclaimed bytes })
+ */
+int *sweepStatus()
+{
+    object *stores;
+    int entries, bytes, i;
+    int *status;
+
+    stores = expiringStores();
+    for (i = sizeof(stores); --i >= 0; ) {
+	status = stores[i]->sweepStatus();
+	entries += status[0];
+	bytes += status[1];
+    }
+
+    return ({ entries, bytes });
+}
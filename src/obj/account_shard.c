@@ -0,0 +1,189 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# include <KVstore.h>
+# include "KVstoreOrd.h"
+# include "account.h"
+# include <type.h>
+
+
+# define PACK_BUDGET	100	/* accounts to pack per task */
+
+object accounts;	/* accountId : account */
+object phoneIndex;	/* phoneNumber : accountId */
+object usernameIndex;	/* username : accountId */
+
+/*
+ * initialize account shard
+ */
+static void create()
+{
+    accounts = new KVstoreOrd(199);
+    phoneIndex = new KVstore(249);
+    usernameIndex = new KVstore(142);
+}
+
+/*
+ * view on a stored account; an account stored as an object is viewed as a
+ * packed record, without storing it again
+ */
+private Account view(string accountId, mixed account)
+{
+    if (typeof(account) == T_OBJECT) {
+	account = account->packed();
+    }
+    return (account) ? new Account(account) : nil;
+}
+
+/*
+ * start replacing accounts stored as objects with packed records
+ */
+void pack()
+{
+    if (previous_program() == ACCOUNT_SERVER) {
+	call_out("packAccounts", 0, accounts->first());
+    }
+}
+
+/*
+ * pack accounts stored as objects, a few at a time
+ */
+static void packAccounts(mixed *cursor)
+{
+    string *keys;
+    mixed *values;
+    int i;
+
+    ({ keys, values, cursor }) = accounts->next(cursor, PACK_BUDGET);
+    for (i = sizeof(keys); --i >= 0; ) {
+	if (typeof(values[i]) == T_OBJECT) {
+	    accounts[keys[i]] = values[i]->record();
+	}
+    }
+    if (cursor) {
+	call_out("packAccounts", 0, cursor);
+    }
+}
+
+/*
+ * add account as a packed record, fails if the ID is already in use
+ */
+void addAccount(string accountId, Account account)
+{
+    if (previous_program() == ACCOUNT_SERVER) {
+	accounts->add(accountId, account->record());
+    }
+}
+
+/*
+ * add phoneNumber : accountId
+ */
+void addPhoneNumber(string phoneNumber, string accountId)
+{
+    if (previous_program() == ACCOUNT_SERVER) {
+	phoneIndex->add(phoneNumber, accountId);
+    }
+}
+
+/*
+ * add username : accountId
+ */
+void addUsername(string username, string accountId)
+{
+    if (previous_program() == ACCOUNT_SERVER) {
+	usernameIndex->add(username, accountId);
+    }
+}
+
+/*
+ * get by account ID
+ */
+Account get(string accountId)
+{
+    return view(accountId, accounts[accountId]);
+}
+
+/*
+ * get multiple accounts by account ID
+ */
+Account *getMany(string *accountIds)
+{
+    Account *list;
+    int i;
+
+    list = allocate(i = sizeof(accountIds));
+    while (--i >= 0) {
+	list[i] = view(accountIds[i], accounts[accountIds[i]]);
+    }
+    return list;
+}
+
+/*
+ * get account ID by phone number
+ */
+string getIdByNumber(string phoneNumber)
+{
+    return phoneIndex[phoneNumber];
+}
+
+/*
+ * get multiple account IDs by phone number
+ */
+string *getIdsByNumber(string *phoneNumbers)
+{
+    string *ids;
+    int i;
+
+    ids = allocate(i = sizeof(phoneNumbers));
+    while (--i >= 0) {
+	ids[i] = phoneIndex[phoneNumbers[i]];
+    }
+    return ids;
+}
+
+/*
+ * phone numbers of stored accounts, a page at a time:
+ * ({ phone numbers, cursor }); start without a cursor
+ */
+mixed *phoneNumbers(mixed *cursor, int n)
+{
+    if (previous_program() == ACCOUNT_SERVER) {
+	string *keys, *numbers;
+	mixed *values;
+	int i;
+
+	({ keys, values, cursor }) = accounts->next((cursor) ?
+						      cursor :
+						      accounts->first(), n);
+	numbers = allocate(i = sizeof(keys));
+	while (--i >= 0) {
+	    if (values[i]) {
+		numbers[i] = view(keys[i], values[i])->phoneNumber();
+	    }
+	}
+	return ({ numbers, cursor });
+    }
+}
+
+/*
+ * get account ID by user name
+ */
+string getIdByName(string username)
+{
+    return usernameIndex[username];
+}
@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -21,6 +21,7 @@
 # include "~HTTP/HttpResponse.h"
 # include "~TLS/x509.h"
 # include "rest.h"
+# include "Deque.h"
 
 inherit rest RestClient;
 private inherit "~/lib/rs256";
@@ -32,7 +33,8 @@ private inherit json "/lib/util/json";
 
 object tokenClient;	/* obtain a firebase access token */
 string accessToken;	/* firebase access token */
-mixed **queue;		/* message queue */
+mixed **queue;		/* message queue, before deques */
+Deque messages;		/* message queue */
 int active;		/* active connection */
 int requested;		/* awaiting response */
 
@@ -71,7 +73,19 @@ static void create()
     clientEmail = map["client_email"];
     tokenUri = map["token_uri"];
 
-    queue = ({ });
+    messages = new Deque();
+}
+
+/*
+ * message queue
+ */
+private Deque messageQueue()
+{
+    if (!messages) {
+	messages = new Deque(queue);
+	queue = nil;
+    }
+    return messages;
 }
 
 /*
@@ -107,7 +121,8 @@ static void sendMessage()
     if (!active) {
 	startConnection();
     } else {
-	({ attempts, callback, target, type, message, urgent }) = queue[0];
+	({ attempts, callback, target, type, message, urgent }) =
+	    messageQueue()->front();
 	message = "{\"message\":{\"token\":\"" + target + "\"," +
 		  "\"data\":{\"" + type + "\":\"" + message + "\"}," +
 		  "\"android\":{\"priority\":\"" +
@@ -126,6 +141,7 @@ static void sendMessage()
  */
 static void response(string context, HttpResponse response, StringBuffer entity)
 {
+    mixed *entry;
     Continuation callback;
 
     requested = FALSE;
@@ -135,18 +151,18 @@ static void response(string context, HttpResponse response, StringBuffer entity)
 	 * Firebase sometimes responds "Requested entity was not found",
 	 * which presumably refers to the token.  Try a few times.
 	 */
-	if (--queue[0][0] > 0) {
+	entry = messageQueue()->front();
+	if (--entry[0] > 0) {
 	    call_out("sendMessage", 0);
 	    break;
 	}
 	/* fall through */
     case HTTP_OK:
-	callback = queue[0][1];
+	callback = messageQueue()->pop()[1];
 	if (callback) {
 	    callback->runNext(response->code());
 	}
-	queue = queue[1 ..];
-	if (sizeof(queue) != 0) {
+	if (messages->size() != 0) {
 	    call_out("sendMessage", 0);
 	}
 	break;
@@ -234,8 +250,10 @@ static void storeAccessToken(int code, StringBuffer entity)
 static void enqueue(string target, string type, string message, int urgent,
 		    Continuation callback)
 {
-    queue += ({ ({ ATTEMPTS, callback, target, type, message, urgent }) });
-    if (sizeof(queue) == 1) {
+    messageQueue()->push(({
+	ATTEMPTS, callback, target, type, message, urgent
+    }));
+    if (messages->size() == 1) {
 	if (!accessToken) {
 	    getAccessToken();
 	} else {
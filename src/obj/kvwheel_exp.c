@@ -0,0 +1,117 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# define KVSTORE_EXP	"/usr/MsgServer/lib/KVstoreExp"
+# define CHUNK_SIZE	8192	/* keys per slot chunk */
+
+private int granularity;	/* seconds per expiry slot */
+private mapping slots;		/* slot : ({ ([ key : size ]) }) */
+private int sweepSlot;		/* next slot to sweep */
+
+/*
+ * part of the expiry index of a KVstoreExp, kept outside the store so that
+ * writers of keys in different parts do not conflict
+ */
+static void create(int granularity)
+{
+    ::granularity = granularity;
+    slots = ([ ]);
+    sweepSlot = time() / granularity;
+}
+
+/*
+ * add a key
+ */
+void index(string key, int expiration, int size)
+{
+    if (previous_program() == KVSTORE_EXP) {
+	int slot;
+	mapping *chunks, chunk;
+
+	slot = expiration / granularity + 1;
+	chunks = slots[slot];
+	if (!chunks) {
+	    slots[slot] = chunks = ({ ([ ]) });
+	}
+	chunk = chunks[sizeof(chunks) - 1];
+	if (map_sizeof(chunk) >= CHUNK_SIZE) {
+	    slots[slot] = chunks + ({ chunk = ([ ]) });
+	}
+	chunk[key] = size;
+    }
+}
+
+/*
+ * remove a key
+ */
+void unindex(string key, int expiration)
+{
+    if (previous_program() == KVSTORE_EXP) {
+	mapping *chunks;
+	int i;
+
+	chunks = slots[expiration / granularity + 1];
+	if (chunks) {
+	    for (i = sizeof(chunks); --i >= 0; ) {
+		chunks[i][key] = nil;
+	    }
+	}
+    }
+}
+
+/*
+ * take at most budget keys from slots that have expired:
+ * ({ keys, sizes, more })
+ */
+mixed *due(int budget)
+{
+    if (previous_program() == KVSTORE_EXP) {
+	int now, i, sz;
+	mapping *chunks, chunk;
+	string *keys, *list;
+	int *sizes, *sizeList;
+
+	list = ({ });
+	sizeList = ({ });
+	for (now = time() / granularity; sweepSlot <= now; sweepSlot++) {
+	    chunks = slots[sweepSlot];
+	    while (chunks) {
+		chunk = chunks[0];
+		keys = map_indices(chunk);
+		sizes = map_values(chunk);
+		if (sizeof(keys) > budget) {
+		    keys = keys[.. budget - 1];
+		    sizes = sizes[.. budget - 1];
+		    for (i = 0, sz = sizeof(keys); i < sz; i++) {
+			chunk[keys[i]] = nil;
+		    }
+		    return ({ list + keys, sizeList + sizes, TRUE });
+		}
+		list += keys;
+		sizeList += sizes;
+		budget -= sizeof(keys);
+
+		chunks = chunks[1 ..];
+		slots[sweepSlot] = (sizeof(chunks) != 0) ? chunks : nil;
+		chunks = slots[sweepSlot];
+	    }
+	}
+
+	return ({ list, sizeList, FALSE });
+    }
+}
@@ -0,0 +1,697 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# include "KVstoreExp.h"
+# include "KVstoreOrd.h"
+# include "Deque.h"
+# include "account.h"
+# include "messages.h"
+
+inherit "~/lib/sweeper";
+inherit "~/lib/journal";
+
+
+# define DURATION	30 * 24 * 3600
+
+# define QUEUE		0	/* queued GUIDs */
+# define SINCE		1	/* oldest resident envelope, or last delivery */
+# define SEGMENTS	2	/* ({ ({ segment, time, envelopes }) }) */
+# define CURSOR		3	/* envelopes handed out for delivery */
+# define RESIDENT	4	/* envelopes read back, before the segments */
+
+# define COMPACT_INTERVAL	3600	/* seconds between compactions */
+# define COMPACT_BUDGET		100	/* mail boxes to compact per task */
+
+# define SEGMENT_DIR		"~/segments"
+# define SPILL_IDLE		(2 * 24 * 3600)	/* idle time before spilling */
+# define SEGMENT_CHUNK		65536	/* bytes per segment read */
+
+# define RECORD_STACK		'S'	/* journal: envelope stacked */
+# define RECORD_REMOVE		'R'	/* journal: envelopes removed */
+# define RECORD_UNSPILL		'U'	/* journal: segment read back */
+
+object messages;	/* messages */
+object mboxes;		/* mail boxes */
+int stored;		/* envelopes stored */
+int removed;		/* envelopes removed after delivery */
+int compacted;		/* expired envelopes removed from mail boxes */
+int spilled;		/* envelopes spilled to segments */
+int expired;		/* envelopes in expired segments */
+int segments;		/* last segment number */
+int *released;		/* segments read back, to remove once journalled */
+private int compacting;	/* compaction started */
+
+/*
+ * initialize message shard
+ */
+static void create()
+{
+    messages = new KVstoreExp(199, DURATION);
+    mboxes = new KVstoreOrd(194);
+}
+
+/*
+ * stores with expiring keys
+ */
+static object *expiringStores()
+{
+    return ({ messages });
+}
+
+/*
+ * keep a stack of envelopes to send later, for mailboxes in this shard
+ */
+atomic void stack(Envelope *envelopes)
+{
+    if (previous_program() == MESSAGE_SERVER) {
+	Envelope envelope;
+	string index, current, guid;
+	mapping mbox;
+	int i, sz, added;
+
+	startSweeper();
+	if (!compacting) {
+	    compacting = TRUE;
+	    call_out("compact", COMPACT_INTERVAL, mboxes->first());
+	}
+
+	for (i = 0, sz = sizeof(envelopes); i < sz; i++) {
+	    envelope = envelopes[i];
+
+	    /* find message queue */
+	    index = envelope->destinationDeviceId() +
+		    envelope->destinationId();
+	    if (index != current) {
+		current = index;
+		mbox = mboxes[index];
+		if (!mbox) {
+		    mboxes[index] = mbox = ([ QUEUE : new Deque(),
+					      SINCE : time() ]);
+		}
+	    }
+
+	    /* add to message queue, unless it is already there */
+	    guid = envelope->guid();
+	    if (!messages[guid]) {
+		messages[guid] = envelope;
+		mbox[QUEUE]->push(guid);
+		journal(RECORD_STACK, envelope->save());
+		added++;
+	    }
+	}
+
+	if (added != 0) {
+	    call_out_summand("countStored", 0, (float) added);
+	}
+    }
+}
+
+/*
+ * segment file
+ */
+private string segmentFile(int segment)
+{
+    int number;
+
+    sscanf(object_name(this_object()), "%*s#%d", number);
+    return SEGMENT_DIR + "/" + number + "." + segment;
+}
+
+/*
+ * envelopes in the form in which they are written to a segment file
+ */
+private string pack(Envelope *envelopes)
+{
+    string *saved;
+    string str, header;
+    int i, length;
+
+    saved = allocate(i = sizeof(envelopes));
+    while (--i >= 0) {
+	str = envelopes[i]->save();
+	length = strlen(str);
+	header = "\0\0\0\0";
+	header[0] = length >> 24;
+	header[1] = length >> 16;
+	header[2] = length >> 8;
+	header[3] = length;
+	saved[i] = header + str;
+    }
+    return implode(saved, "");
+}
+
+/*
+ * envelopes from their packed form
+ */
+private Envelope *unpack(string buf)
+{
+    Envelope *envelopes;
+    int i, length;
+
+    envelopes = ({ });
+    for (i = 0; i + 4 <= strlen(buf); i += 4 + length) {
+	length = (buf[i] << 24) | (buf[i + 1] << 16) | (buf[i + 2] << 8) |
+		 buf[i + 3];
+	envelopes += ({ new Envelope(buf[i + 4 .. i + 3 + length]) });
+    }
+    return envelopes;
+}
+
+/*
+ * read back the envelopes in a segment, in sequential chunks
+ */
+private Envelope *unspill(int segment)
+{
+    string file, buf;
+    Envelope *envelopes;
+    int offset, length, i;
+
+    file = segmentFile(segment);
+    envelopes = ({ });
+    offset = 0;
+    while ((buf=read_file(file, offset, SEGMENT_CHUNK)) && strlen(buf) >= 4) {
+	for (i = 0; i + 4 <= strlen(buf); i += 4 + length) {
+	    length = (buf[i] << 24) | (buf[i + 1] << 16) | (buf[i + 2] << 8) |
+		     buf[i + 3];
+	    if (i + 4 + length > strlen(buf)) {
+		if (i != 0) {
+		    break;
+		}
+
+		/* envelope larger than a chunk */
+		buf = read_file(file, offset, 4 + length);
+		if (strlen(buf) < 4 + length) {
+		    return envelopes;	/* truncated */
+		}
+	    }
+
+	    envelopes += ({ new Envelope(buf[i + 4 .. i + 3 + length]) });
+	}
+	offset += i;
+    }
+
+    return envelopes;
+}
+
+/*
+ * store envelopes read back from a segment again until delivery is
+ * acknowledged, and queue them after those read back before, ahead of the
+ * remaining segments and the envelopes stacked after spilling
+ */
+private void resident(mapping mbox, Envelope *envelopes)
+{
+    string *guids, *elements;
+    int i, n;
+
+    guids = allocate(i = sizeof(envelopes));
+    while (--i >= 0) {
+	guids[i] = envelopes[i]->guid();
+	messages[guids[i]] = envelopes[i];
+    }
+
+    n = (mbox[RESIDENT]) ? mbox[RESIDENT] : 0;
+    if (sizeof(guids) != 0) {
+	elements = mbox[QUEUE]->elements();
+	mbox[QUEUE] = new Deque(elements[.. n - 1] + guids + elements[n ..]);
+	n += sizeof(guids);
+    }
+    mbox[RESIDENT] = (mbox[SEGMENTS]) ? n : nil;
+}
+
+/*
+ * read back the first remaining segment of a mail box
+ */
+private void unspillNext(mapping mbox)
+{
+    mixed **spill;
+    Envelope *envelopes;
+    string header;
+    int segment;
+
+    spill = mbox[SEGMENTS];
+    segment = spill[0][0];
+    spilled -= spill[0][2];
+    mbox[SEGMENTS] = (sizeof(spill) > 1) ? spill[1 ..] : nil;
+
+    envelopes = unspill(segment);
+    resident(mbox, envelopes);
+    header = "\0\0\0\0";
+    header[0] = segment >> 24;
+    header[1] = segment >> 16;
+    header[2] = segment >> 8;
+    header[3] = segment;
+    journal(RECORD_UNSPILL, header + pack(envelopes));
+
+    /* the segment file is needed until the journal has been written */
+    released = (released) ? released + ({ segment }) : ({ segment });
+}
+
+/*
+ * the message queue of a mail box, with acknowledged envelopes removed from
+ * the front
+ */
+private Deque mailboxQueue(mapping mbox)
+{
+    Deque queue;
+
+    queue = mbox[QUEUE];
+    while (queue->size() != 0 && !messages[queue->front()]) {
+	queue->pop();
+	if (mbox[CURSOR]) {
+	    mbox[CURSOR]--;
+	}
+	if (mbox[RESIDENT]) {
+	    mbox[RESIDENT]--;
+	}
+    }
+    return queue;
+}
+
+/*
+ * the number of queued envelopes that can be handed out before the next
+ * segment must be read back
+ */
+private int available(mapping mbox)
+{
+    if (mbox[SEGMENTS]) {
+	return (mbox[RESIDENT]) ? mbox[RESIDENT] : 0;
+    }
+    return mbox[QUEUE]->size();
+}
+
+/*
+ * restored from a snapshot: replay the journal
+ */
+void reboot()
+{
+    if (previous_program() == MESSAGE_SERVER) {
+	journalCheck();
+    }
+}
+
+/*
+ * get the next page of stacked envelopes for a device, from its delivery
+ * cursor: ({ envelopes, more }), or nil while the journal is replayed; the
+ * envelopes remain stored until delivery
+ * is acknowledged, and when the device reconnects, delivery resumes with the
+ * first envelope that was not acknowledged
+ */
+atomic mixed *next(string accountId, int deviceId, int n, int reconnect)
+{
+    if (previous_program() == MESSAGE_SERVER) {
+	string index;
+	mapping mbox;
+	Deque queue;
+	Envelope *envelopes;
+	string *guids;
+	int cursor, end;
+
+	journalCheck();
+	if (journalReplaying()) {
+	    return nil;		/* try again later */
+	}
+	index = deviceId + accountId;
+	mbox = mboxes[index];
+	if (!mbox) {
+	    return ({ ({ }), FALSE });
+	}
+	if (reconnect) {
+	    mbox[CURSOR] = nil;
+	}
+	queue = mailboxQueue(mbox);
+	if (queue->size() == 0 && !mbox[SEGMENTS]) {
+	    mboxes[index] = nil;
+	    return ({ ({ }), FALSE });
+	}
+
+	cursor = (mbox[CURSOR]) ? mbox[CURSOR] : 0;
+	if (cursor > queue->size()) {
+	    cursor = queue->size();
+	}
+	if (mbox[SEGMENTS] && cursor >= available(mbox)) {
+	    /* the cursor reached the next segment */
+	    unspillNext(mbox);
+	    queue = mbox[QUEUE];
+	}
+	end = available(mbox);
+	do {
+	    guids = queue->peek((end - cursor < n) ? end - cursor : n, cursor);
+	    cursor += sizeof(guids);
+	    envelopes = messages->getMany(guids) - ({ nil });
+	} while (sizeof(envelopes) == 0 && cursor < end);
+	mbox[CURSOR] = cursor;
+	mbox[SINCE] = time();
+
+	return ({ envelopes, cursor < queue->size() || mbox[SEGMENTS] });
+    }
+}
+
+/*
+ * fetch a page of stacked envelopes for a mailbox in this shard, without
+ * taking them: ({ envelopes, more })
+ */
+atomic mixed *fetch(string accountId, int deviceId, int n)
+{
+    if (previous_program() == MESSAGE_SERVER) {
+	string index;
+	mapping mbox;
+	Deque queue;
+
+	journalCheck();
+	if (journalReplaying()) {
+	    return ({ ({ }), TRUE });	/* poll again */
+	}
+	index = deviceId + accountId;
+	mbox = mboxes[index];
+	if (!mbox) {
+	    return ({ ({ }), FALSE });
+	}
+
+	/* skip envelopes removed since the previous page */
+	queue = mailboxQueue(mbox);
+	if (queue->size() == 0 && !mbox[SEGMENTS]) {
+	    mboxes[index] = nil;
+	    return ({ ({ }), FALSE });
+	}
+	if (mbox[SEGMENTS] && available(mbox) == 0) {
+	    unspillNext(mbox);
+	    queue = mbox[QUEUE];
+	}
+	if (n > available(mbox)) {
+	    n = available(mbox);
+	}
+
+	return ({ messages->getMany(queue->peek(n)) - ({ nil }),
+		  queue->size() > n || mbox[SEGMENTS] });
+    }
+}
+
+/*
+ * get a stored envelope
+ */
+Envelope get(string guid)
+{
+    if (previous_program() == MESSAGE_SERVER) {
+	return messages[guid];
+    }
+}
+
+/*
+ * remove envelopes of which delivery was acknowledged
+ */
+atomic void remove(string *guids)
+{
+    if (previous_program() == MESSAGE_SERVER) {
+	int i, count;
+
+	for (i = sizeof(guids); --i >= 0; ) {
+	    if (messages[guids[i]]) {
+		messages[guids[i]] = nil;
+		count++;
+	    }
+	}
+
+	if (count != 0) {
+	    call_out_summand("countRemoved", 0, (float) count);
+	    journal(RECORD_REMOVE, implode(guids, ""));
+	}
+    }
+}
+
+/*
+ * replay a journal record, written after the last snapshot; envelopes that
+ * were already stored at the time of the snapshot are skipped, and so are
+ * segments that were already read back
+ */
+static void replayRecord(int type, string payload)
+{
+    Envelope envelope;
+    Envelope *envelopes;
+    string index, guid;
+    mapping mbox;
+    mixed **spill;
+    int segment, i;
+
+    switch (type) {
+    case RECORD_STACK:
+	envelope = new Envelope(payload);
+	guid = envelope->guid();
+	if (!messages[guid]) {
+	    index = envelope->destinationDeviceId() + envelope->destinationId();
+	    mbox = mboxes[index];
+	    if (!mbox) {
+		mboxes[index] = mbox = ([ QUEUE : new Deque(),
+					  SINCE : time() ]);
+	    }
+	    messages[guid] = envelope;
+	    mbox[QUEUE]->push(guid);
+	    stored++;
+	}
+	break;
+
+    case RECORD_UNSPILL:
+	segment = (payload[0] << 24) | (payload[1] << 16) | (payload[2] << 8) |
+		  payload[3];
+	envelopes = unpack(payload[4 ..]);
+	if (sizeof(envelopes) != 0) {
+	    index = envelopes[0]->destinationDeviceId() +
+		    envelopes[0]->destinationId();
+	    mbox = mboxes[index];
+	    spill = (mbox) ? mbox[SEGMENTS] : nil;
+	    if (spill && spill[0][0] == segment) {
+		spilled -= spill[0][2];
+		mbox[SEGMENTS] = (sizeof(spill) > 1) ? spill[1 ..] : nil;
+		resident(mbox, envelopes);
+		released = (released) ? released + ({ segment }) :
+					({ segment });
+	    }
+	}
+	break;
+
+    case RECORD_REMOVE:
+	for (i = 0; i < strlen(payload); i += 16) {
+	    guid = payload[i .. i + 15];
+	    if (messages[guid]) {
+		messages[guid] = nil;
+		removed++;
+	    }
+	}
+	break;
+    }
+}
+
+/*
+ * count stored envelopes
+ */
+static void countStored(float number)
+{
+    stored += (int) number;
+}
+
+/*
+ * count envelopes removed after delivery
+ */
+static void countRemoved(float number)
+{
+    removed += (int) number;
+}
+
+/*
+ * remove segment files
+ */
+static void removeSegments(int *unused)
+{
+    int i;
+
+    for (i = sizeof(unused); --i >= 0; ) {
+	remove_file(segmentFile(unused[i]));
+    }
+}
+
+/*
+ * the journal was written: segments read back are no longer needed
+ */
+static void journalCommitted()
+{
+    if (released && sizeof(released) != 0) {
+	removeSegments(released);
+	released = ({ });
+    }
+}
+
+/*
+ * remove expired envelopes from mail boxes, a few mail boxes at a time, and
+ * find idle mail boxes to spill
+ */
+static atomic void compact(mixed *cursor)
+{
+    mixed *keys, *boxes, **spill;
+    string *guids, *idle;
+    int *unused;
+    mapping mbox;
+    int i, j, count, handed, before;
+
+    idle = ({ });
+    unused = ({ });
+    ({ keys, boxes, cursor }) = mboxes->next(cursor, COMPACT_BUDGET);
+    for (i = sizeof(keys); --i >= 0; ) {
+	mbox = boxes[i];
+	if (mbox) {
+	    guids = mbox[QUEUE]->elements();
+	    handed = (mbox[CURSOR]) ? mbox[CURSOR] : 0;
+	    before = (mbox[RESIDENT]) ? mbox[RESIDENT] : 0;
+	    for (j = sizeof(guids); --j >= 0; ) {
+		if (!messages[guids[j]]) {
+		    guids[j] = nil;
+		    count++;
+		    if (j < handed) {
+			/* keep the cursor at the same envelope */
+			mbox[CURSOR]--;
+		    }
+		    if (j < before) {
+			mbox[RESIDENT]--;
+		    }
+		}
+	    }
+	    guids -= ({ nil });
+	    if (sizeof(guids) != mbox[QUEUE]->size()) {
+		mbox[QUEUE] = new Deque(guids);
+	    }
+
+	    /* segments expire as a whole */
+	    spill = mbox[SEGMENTS];
+	    if (spill) {
+		for (j = sizeof(spill); --j >= 0; ) {
+		    if (time() - spill[j][1] >= DURATION) {
+			unused += ({ spill[j][0] });
+			count += spill[j][2];
+			spilled -= spill[j][2];
+			expired += spill[j][2];
+			spill[j] = nil;
+		    }
+		}
+		spill -= ({ nil });
+		if (sizeof(spill) != 0) {
+		    mbox[SEGMENTS] = spill;
+		} else {
+		    mbox[SEGMENTS] = mbox[RESIDENT] = nil;
+		}
+	    }
+
+	    if (sizeof(guids) == 0 && !mbox[SEGMENTS]) {
+		mboxes[keys[i]] = nil;
+	    } else if (!mbox[SINCE]) {
+		mbox[SINCE] = time();	/* before spilling */
+	    } else if (sizeof(guids) != 0 &&
+		       time() - mbox[SINCE] >= SPILL_IDLE) {
+		idle += ({ keys[i] });
+	    }
+	}
+    }
+    compacted += count;
+    if (sizeof(idle) != 0) {
+	call_out("spill", 0, idle);
+    }
+    if (sizeof(unused) != 0) {
+	call_out("removeSegments", 0, unused);
+    }
+
+    if (cursor) {
+	call_out("compact", 0, cursor);
+    } else {
+	call_out("compact", COMPACT_INTERVAL, mboxes->first());
+    }
+}
+
+/*
+ * write envelopes to a new segment file: ({ segment, time, envelopes }), or
+ * nil if there are none
+ */
+private mixed *writeSegment(Envelope *envelopes)
+{
+    if (sizeof(envelopes) == 0) {
+	return nil;
+    }
+
+    /* a task can be repeated: overwrite rather than append */
+    remove_file(segmentFile(++segments));
+    if (!write_file(segmentFile(segments), pack(envelopes))) {
+	error("Cannot write segment");
+    }
+    spilled += sizeof(envelopes);
+    return ({ segments, time(), sizeof(envelopes) });
+}
+
+/*
+ * move the queued envelopes of idle mail boxes to segment files, so they no
+ * longer take up space in the resident set; envelopes read back before are
+ * written to a segment ahead of the remaining ones, to keep them in order.
+ * Mail boxes of devices that are online are skipped, since a connection may
+ * still be delivering envelopes from them.  Not atomic, since files are
+ * written; a spill that is lost in a restart leaves the envelopes stored in
+ * the snapshot, and the segment file is overwritten later
+ */
+static void spill(string *idle)
+{
+    mapping mbox;
+    string *guids;
+    mixed *front, *back;
+    string index;
+    int i, j, n;
+
+    if (sizeof(get_dir(SEGMENT_DIR)[0]) == 0) {
+	make_dir(SEGMENT_DIR);
+    }
+
+    for (i = sizeof(idle); --i >= 0; ) {
+	index = idle[i];
+	mbox = mboxes[index];
+	if (mbox && mbox[QUEUE]->size() != 0 &&
+	    /* the index is the device ID followed by the account ID */
+	    !ONLINE_REGISTRY->present(index[strlen(index) - 16 ..],
+				      (int) index[.. strlen(index) - 17])) {
+	    guids = mbox[QUEUE]->elements();
+	    n = (mbox[SEGMENTS] && mbox[RESIDENT]) ? mbox[RESIDENT] : 0;
+	    front = writeSegment(messages->getMany(guids[.. n - 1]) -
+				 ({ nil }));
+	    back = writeSegment(messages->getMany(guids[n ..]) - ({ nil }));
+	    mbox[SEGMENTS] = ((front) ? ({ front }) : ({ })) +
+			     ((mbox[SEGMENTS]) ? mbox[SEGMENTS] : ({ })) +
+			     ((back) ? ({ back }) : ({ }));
+	    if (sizeof(mbox[SEGMENTS]) == 0) {
+		mbox[SEGMENTS] = nil;
+	    }
+	    for (j = sizeof(guids); --j >= 0; ) {
+		messages[guids[j]] = nil;
+	    }
+	    mbox[QUEUE] = new Deque();
+	    mbox[SINCE] = time();
+	    mbox[CURSOR] = mbox[RESIDENT] = nil;
+	}
+    }
+}
+
+/*
+ * envelope status: ({ resident envelopes, envelopes removed after delivery,
+ * expired envelopes removed from mail boxes, envelopes spilled to segments })
+ */
+int *envelopeStatus()
+{
+    return ({ stored - removed - messages->sweepStatus()[0] - spilled -
+	      expired, removed, compacted, spilled });
+}
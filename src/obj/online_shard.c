@@ -0,0 +1,145 @@
+/*
+ * This file is part of https://github.com/LPC-language/signal-server
+ * Copyright (C) 2026 Dworkin B.V.  All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+# include <KVstore.h>
+# include "account.h"
+
+# define ENDPOINT	0	/* entry: WebSocket endpoint */
+# define GENERATION	1	/* entry: registration generation */
+
+
+object accounts;	/* accountId : ([ deviceId : entry ]) */
+int registrations;	/* endpoints registered */
+int unregistrations;	/* endpoints unregistered or replaced */
+
+/*
+ * initialize online shard
+ */
+static void create()
+{
+    accounts = new KVstore(194);
+}
+
+/*
+ * register WebSocket endpoint, and return its generation; a newer
+ * registration for the same device replaces an older one
+ */
+int register(string id, int deviceId, object endpoint)
+{
+    if (previous_program() == ONLINE_REGISTRY) {
+	mapping devices;
+	mixed *entry;
+	int generation;
+
+	devices = accounts[id];
+	if (!devices) {
+	    devices = ([ ]);
+	}
+	entry = devices[deviceId];
+	if (entry) {
+	    generation = entry[GENERATION];
+	    call_out_summand("countUnregistrations", 0, 1.0);
+	}
+	devices[deviceId] = ({ endpoint, ++generation });
+	accounts[id] = devices;
+	call_out_summand("countRegistrations", 0, 1.0);
+
+	return generation;
+    }
+}
+
+/*
+ * unregister WebSocket endpoint, unless it was replaced by a newer one; the
+ * generation restarts when a device has no registration, so the endpoint
+ * must match as well
+ */
+void unregister(string id, int deviceId, int generation, object endpoint)
+{
+    if (previous_program() == ONLINE_REGISTRY) {
+	mapping devices;
+	mixed *entry;
+
+	devices = accounts[id];
+	if (devices && (entry=devices[deviceId]) &&
+	    entry[GENERATION] == generation && entry[ENDPOINT] == endpoint) {
+	    devices[deviceId] = nil;
+	    accounts[id] = (map_sizeof(devices) != 0) ? devices : nil;
+	    call_out_summand("countUnregistrations", 0, 1.0);
+	}
+    }
+}
+
+/*
+ * get the active WebSocket endpoint of a device
+ */
+object present(string id, int deviceId)
+{
+    mapping devices;
+
+    devices = accounts[id];
+    return (devices && devices[deviceId]) ?
+	    devices[deviceId][ENDPOINT] : nil;
+}
+
+/*
+ * get the active WebSocket endpoints of an account: ([ deviceId : endpoint ])
+ */
+mapping online(string id)
+{
+    mapping devices, online;
+    int *deviceIds;
+    mixed **entries;
+    int i;
+
+    online = ([ ]);
+    devices = accounts[id];
+    if (devices) {
+	deviceIds = map_indices(devices);
+	entries = map_values(devices);
+	for (i = sizeof(deviceIds); --i >= 0; ) {
+	    if (entries[i][ENDPOINT]) {
+		online[deviceIds[i]] = entries[i][ENDPOINT];
+	    }
+	}
+    }
+    return online;
+}
+
+/*
+ * count registrations
+ */
+static void countRegistrations(float number)
+{
+    registrations += (int) number;
+}
+
+/*
+ * count unregistrations
+ */
+static void countUnregistrations(float number)
+{
+    unregistrations += (int) number;
+}
+
+/*
+ * online status: ({ registrations, unregistrations })
+ */
+int *onlineStatus()
+{
+    return ({ registrations, unregistrations });
+}
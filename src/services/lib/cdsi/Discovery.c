@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -37,7 +37,6 @@ inherit RestServer;
 private inherit "/lib/util/ascii";
 private inherit base64 "/lib/util/base64";
 private inherit "~/lib/proto";
-private inherit "~/lib/phone";
 
 
 # define STATE_INIT		0
@@ -190,14 +189,15 @@ private void sendClientResponse(string *results)
 static void cdsiBatch(string *numbers, string *results, int offset)
 {
     int size, i;
-    Account account;
+    Account *accounts, account;
 
     size = sizeof(numbers);
     if (offset + BATCH_SIZE < size) {
 	size = offset + BATCH_SIZE;
     }
+    accounts = ACCOUNT_SERVER->getManyByNum(numbers[offset .. size - 1]);
     for (i = offset; i < size; i++) {
-	account = ACCOUNT_SERVER->getByNumber(numToPhone(numbers[i]));
+	account = accounts[i - offset];
 	results[i] = numbers[i] + ((account) ?
 				    account->pni() + account->id() :
 				    "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0" +
@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024-2025 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -19,8 +19,14 @@
 # ifdef REGISTER
 
 register(CHAT_SERVER, "PUT", "/v1/messages/{}",
-	 "putMessages", argHeaderAuth(), argHeader("Unidentified-Access-Key"),
+	 "putMessages", argHeaderOptAuth(), argHeader("Unidentified-Access-Key"),
 	 argEntityJson());
+register(CHAT_SERVER, "PUT", "/v1/messages/multi_recipient?{}",
+	 "putMultiRecipientMessages", argHeader("Unidentified-Access-Key"),
+	 argEntity());
+register(CHAT_SERVER, "GET", "/v1/messages", "getMessages", argHeaderAuth());
+register(CHAT_SERVER, "DELETE", "/v1/messages/uuid/{}", "deleteMessage",
+	 argHeaderAuth());
 
 # else
 
@@ -32,88 +38,514 @@ register(CHAT_SERVER, "PUT", "/v1/messages/{}",
 # include "account.h"
 # include "messages.h"
 # include "fcm.h"
+# include "Deque.h"
 # include <status.h>
 
 inherit RestServer;
 private inherit base64 "/lib/util/base64";
 private inherit uuid "~/lib/uuid";
+private inherit "~/lib/proto";
 
 
-# define READY			0
-# define AWAIT_RESPONSE		1
-
 # define RECEIPT		5
+# define UNIDENTIFIED_SENDER	6
+
+# define MULTI_RECIPIENT	0x22	/* multi-recipient message version */
+# define MULTI_RECIPIENT_ID	0x23	/* same, with service ID types */
+# define KEY_MATERIAL_SIZE	48	/* per-recipient key material */
+# define MAX_SHARED_SIZE	65535	/* maximum shared payload */
+# define MESSAGE_PAGE		100	/* messages per GET /v1/messages */
+# define RECEIPT_DELAY		0.1	/* seconds to collect receipts */
+# define DELIVERY_WINDOW	16	/* envelopes in flight per connection */
+# define DELIVERY_TIMEOUT	30	/* seconds before redelivery */
+# define LOW_WATER		25	/* queued envelopes before the next page */
+
+# define PAGE_NONE		0	/* no more stored envelopes */
+# define PAGE_MORE		1	/* more stored envelopes in the mail box */
+# define PAGE_REQUESTED		2	/* next page requested */
+
+private object *queue;		/* envelope queue, before deques */
+private Deque envelopes;	/* envelope queue */
+private mapping stored;		/* GUIDs of envelopes from the message server */
+private mapping receipts;	/* device + account : ({ origin, ... }) */
+private mapping inFlight;	/* GUID : ({ envelope, context, timeout }) */
+private int paging;		/* paging state of stored envelopes */
+private int emptied;		/* client told that the queue is empty */
+private int parked;		/* envelopes parked since the last page */
+private mixed *mailbox;		/* ({ accountId, deviceId }) */
+private mapping stamp;		/* X-Signal-Timestamp header for this tick */
+private int stampTime;		/* time of the header */
+private float stampMtime;	/* millisecond time of the header */
 
-private object *queue;		/* envelope queue */
-private int state;		/* delivery state */
+static string chatSendRequest(string verb, string path, StringBuffer body,
+			      mapping extraHeaders, Continuation cont,
+			      varargs mixed arguments...);
+static void chatCancelRequest(string context);
+static void chatUnregister();
 
-static void chatSendRequest(string verb, string path, StringBuffer body,
-			    mapping extraHeaders, Continuation cont,
-			    varargs mixed arguments...);
+private int equalKey(string key1, string key2);
 
+/*
+ * send messages to a single recipient, either authenticated or as an
+ * unidentified sender
+ */
 static void putMessages(string context, string uuid, Account account,
 			Device device, string accessKey, mapping entity)
 {
     string story, destination;
+    Account recipient;
 
     sscanf(uuid, "%s?story=%s", uuid, story);
     destination = entity["destination"];
 
-    call_out("putMessages2", 0, context,
-	     (destination) ?
-	      ACCOUNT_SERVER->get(uuid::decode(destination)) : account,
-	     account->id(), device->id(), entity["messages"],
-	     new Timestamp(entity["timestamp"]), entity["urgent"]);
+    if (account) {
+	call_out("putMessages2", 0, context,
+		 (destination) ?
+		  ACCOUNT_SERVER->get(uuid::decode(destination)) : account,
+		 account->id(), device->id(), entity["messages"],
+		 new Timestamp(entity["timestamp"]), entity["urgent"],
+		 entity["online"]);
+	return;
+    }
+
+    /*
+     * unidentified sender: check the access key of the recipient, rather
+     * than the password of the sender
+     */
+    if (!accessKey && story != "true") {
+	respond(context, HTTP_UNAUTHORIZED, nil, nil);
+	return;
+    }
+    try {
+	recipient = ACCOUNT_SERVER->get(uuid::decode((destination) ?
+						     destination : uuid));
+	if (accessKey) {
+	    accessKey = base64::decode(accessKey);
+	}
+    } catch (...) {
+	respond(context, HTTP_BAD_REQUEST, nil, nil);
+	return;
+    }
+    if (!recipient) {
+	respond(context, HTTP_NOT_FOUND, nil, nil);
+	return;
+    }
+    if (story != "true" && !recipient->unrestrictedAccess() &&
+	!equalKey(recipient->unidentifiedAccessKey(), accessKey)) {
+	respond(context, HTTP_UNAUTHORIZED, nil, nil);
+	return;
+    }
+
+    call_out("putMessages2", 0, context, recipient, nil, 0,
+	     entity["messages"], new Timestamp(entity["timestamp"]),
+	     entity["urgent"], entity["online"]);
 }
 
+/*
+ * deliver messages to online devices, and store them for offline devices;
+ * online-only messages for offline devices are dropped
+ */
 static void putMessages2(string context, Account account, string sourceId,
 			 int sourceDeviceId, mapping *messages,
-			 Timestamp timestamp, int urgent)
+			 Timestamp timestamp, int urgent, int onlineOnly)
 {
     string destinationId, content;
     int size, i, deviceId;
+    int *deviceIds;
     mapping online, message;
     object endpoint;
-    Envelope envelope;
+    Envelope envelope, *stacked;
 
     destinationId = account->id();
-    online = ([ ]);
-    for (size = sizeof(messages), i = 0; i < size; i++) {
+    size = sizeof(messages);
+    deviceIds = allocate_int(size);
+    for (i = 0; i < size; i++) {
+	deviceIds[i] = messages[i]["destinationDeviceId"];
+    }
+    online = ONLINE_REGISTRY->online(destinationId, deviceIds);
+    stacked = ({ });
+    for (i = 0; i < size; i++) {
+	deviceId = deviceIds[i];
+	endpoint = online[deviceId];
+	if (!endpoint && onlineOnly) {
+	    continue;
+	}
 	message = messages[i];
-	envelope = new Envelope(this_object(), sourceId, sourceDeviceId,
-				message["type"],
+	envelope = new Envelope((sourceId) ? this_object() : nil, sourceId,
+				sourceDeviceId, message["type"],
 				new String(base64::decode(message["content"])),
-				timestamp, destinationId, deviceId, urgent);
-	deviceId = message["destinationDeviceId"];
-	endpoint = online[deviceId];
+				timestamp, destinationId, deviceId, urgent, nil,
+				onlineOnly);
 	if (!endpoint) {
-	    endpoint = ONLINE_REGISTRY->present(destinationId, deviceId);
+	    FCM_RELAY->sendNotification(account->device(deviceId)->gcmId(),
+					urgent);
+	    stacked += ({ envelope });
+	    continue;
+	}
+
+	call_out_other(endpoint, "deliver", 0, ({ envelope }));
+    }
+    if (sizeof(stacked) != 0) {
+	call_out_other(MESSAGE_SERVER, "stack", 0, stacked);
+    }
+
+    respondJson(context, HTTP_OK, ([ "needsSync" : FALSE ]));
+}
+
+/*
+ * parse a multi-recipient message: ({ recipients, shared payload }), where
+ * each recipient is ({ accountId, ({ deviceId, registrationId, ... }),
+ * key material })
+ */
+private mixed *parseMultiRecipient(StringBuffer entity)
+{
+    int version, count, deviceId, registrationId, i;
+    string buf, serviceId, keyMaterial, shared, str;
+    mixed **recipients;
+    int *devices;
+
+    ({ version, buf, i }) = parseByte(entity, nil, 0);
+    if (version != MULTI_RECIPIENT && version != MULTI_RECIPIENT_ID) {
+	error("Unsupported version");
+    }
+    ({ count, buf, i }) = parseInt(entity, buf, i);
+    recipients = allocate(count);
+    while (--count >= 0) {
+	if (version == MULTI_RECIPIENT) {
+	    ({ serviceId, buf, i }) = parseBytes(entity, buf, i, 16);
+	} else {
+	    ({ serviceId, buf, i }) = parseBytes(entity, buf, i, 17);
+	    if (serviceId[0] != 0) {
+		error("Not an ACI");
+	    }
+	    serviceId = serviceId[1 ..];
+	}
+
+	devices = ({ });
+	do {
+	    ({ deviceId, buf, i }) = parseInt(entity, buf, i);
+	    if (deviceId == 0) {
+		break;	/* excluded recipient */
+	    }
+	    ({ str, buf, i }) = parseBytes(entity, buf, i, 2);
+	    registrationId = (str[0] << 8) | str[1];
+	    devices += ({ deviceId, registrationId & 0x7fff });
+	} while (registrationId & 0x8000);
+
+	if (sizeof(devices) != 0) {
+	    ({ keyMaterial, buf, i }) = parseBytes(entity, buf, i,
+						   KEY_MATERIAL_SIZE);
+	    recipients[count] = ({ serviceId, devices, keyMaterial });
+	}
+    }
+
+    for (shared = buf[i ..]; (str=entity->chunk()); shared += str) {
+	if (strlen(shared) + strlen(str) > MAX_SHARED_SIZE) {
+	    error("Payload too large");
+	}
+    }
+
+    return ({ recipients - ({ nil }), shared });
+}
+
+/*
+ * send a sealed sender message to multiple recipients
+ */
+static void putMultiRecipientMessages(string context, string query,
+				      string accessKey, StringBuffer entity)
+{
+    string *params, param, value, shared;
+    mapping args;
+    mixed **recipients;
+    int i;
+
+    args = ([ ]);
+    for (params = explode(query, "&"), i = sizeof(params); --i >= 0; ) {
+	if (sscanf(params[i], "%s=%s", param, value) == 2) {
+	    args[param] = value;
+	}
+    }
+
+    try {
+	({ recipients, shared }) = parseMultiRecipient(entity);
+	if (sizeof(recipients) == 0 || !args["ts"]) {
+	    error("Bad request");
+	}
+	if (accessKey) {
+	    accessKey = base64::decode(accessKey);
+	}
+    } catch (...) {
+	respond(context, HTTP_BAD_REQUEST, nil, nil);
+	return;
+    }
+
+    call_out("putMultiRecipientMessages2", 0, context, recipients,
+	     new String(shared), new Timestamp(args["ts"]),
+	     args["urgent"] != "false", args["story"] == "true",
+	     args["online"] == "true", accessKey);
+}
+
+/*
+ * combine two unidentified access keys
+ */
+private string xorKey(string key1, string key2)
+{
+    int i;
+
+    for (i = strlen(key1); --i >= 0; ) {
+	key1[i] = key1[i] ^ key2[i];
+    }
+    return key1;
+}
+
+/*
+ * compare two unidentified access keys in constant time
+ */
+private int equalKey(string key1, string key2)
+{
+    int diff, i;
+
+    if (!key1 || !key2 || strlen(key1) != strlen(key2)) {
+	return FALSE;
+    }
+    for (i = strlen(key1); --i >= 0; ) {
+	diff |= key1[i] ^ key2[i];
+    }
+    return (diff == 0);
+}
+
+/*
+ * check recipients and fan out the message to online endpoints and mail
+ * boxes in a single pass
+ */
+static void putMultiRecipientMessages2(string context, mixed **recipients,
+				       String content, Timestamp timestamp,
+				       int urgent, int story, int onlineOnly,
+				       string accessKey)
+{
+    string *ids, *notFound, combined, key, header;
+    Account *accounts, account;
+    Device *list;
+    mapping registered, online;
+    mapping *mismatched, *stale, *presence;
+    int *devices, *missing, *extra, *staleIds;
+    int **deviceLists;
+    int sz, i, j, deviceId;
+    object *endpoints, endpoint;
+    Envelope envelope, *stacked;
+
+    ids = allocate(sz = sizeof(recipients));
+    for (i = 0; i < sz; i++) {
+	ids[i] = recipients[i][0];
+    }
+    accounts = ACCOUNT_SERVER->getMany(ids);
+
+    /*
+     * check access and devices
+     */
+    combined = "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0";
+    notFound = ({ });
+    mismatched = stale = ({ });
+    for (i = 0; i < sz; i++) {
+	account = accounts[i];
+	if (!account) {
+	    notFound += ({ uuid::encode(ids[i]) });
+	    continue;
+	}
+	if (!account->unrestrictedAccess()) {
+	    key = account->unidentifiedAccessKey();
+	    combined = (key && combined) ? xorKey(combined, key) : nil;
+	}
+
+	registered = ([ ]);
+	for (list = account->devices(), j = sizeof(list); --j >= 0; ) {
+	    registered[list[j]->id()] = list[j]->registrationId();
+	}
+	missing = map_indices(registered);
+	extra = staleIds = ({ });
+	devices = recipients[i][1];
+	for (j = 0; j < sizeof(devices); j += 2) {
+	    deviceId = devices[j];
+	    if (registered[deviceId] == nil) {
+		extra += ({ deviceId });
+	    } else {
+		missing -= ({ deviceId });
+		if (registered[deviceId] != devices[j + 1]) {
+		    staleIds += ({ deviceId });
+		}
+	    }
+	}
+	if (sizeof(missing) != 0 || sizeof(extra) != 0) {
+	    mismatched += ({ ([
+		"uuid" : uuid::encode(ids[i]),
+		"devices" : ([
+		    "missingDevices" : missing,
+		    "extraDevices" : extra
+		])
+	    ]) });
+	}
+	if (sizeof(staleIds) != 0) {
+	    stale += ({ ([
+		"uuid" : uuid::encode(ids[i]),
+		"devices" : ([ "staleDevices" : staleIds ])
+	    ]) });
+	}
+    }
+
+    if (!story && !equalKey(combined, accessKey)) {
+	respond(context, HTTP_UNAUTHORIZED, nil, nil);
+	return;
+    }
+    if (sizeof(mismatched) != 0) {
+	respondJson(context, HTTP_CONFLICT, mismatched);
+	return;
+    }
+    if (sizeof(stale) != 0) {
+	respondJson(context, HTTP_GONE, stale);
+	return;
+    }
+
+    /*
+     * one envelope per device, all sharing the same content
+     */
+    deviceLists = allocate(sz);
+    for (i = 0; i < sz; i++) {
+	devices = recipients[i][1];
+	deviceLists[i] = allocate_int(sizeof(devices) / 2);
+	for (j = 0; j < sizeof(devices); j += 2) {
+	    deviceLists[i][j / 2] = devices[j];
+	}
+    }
+    presence = ONLINE_REGISTRY->onlineMany(ids, deviceLists);
+    online = ([ ]);
+    stacked = ({ });
+    for (i = 0; i < sz; i++) {
+	account = accounts[i];
+	if (!account) {
+	    continue;
+	}
+	header = "\x22" + recipients[i][2];
+	devices = recipients[i][1];
+	for (j = 0; j < sizeof(devices); j += 2) {
+	    deviceId = devices[j];
+	    endpoint = presence[i][deviceId];
+	    if (!endpoint && onlineOnly) {
+		continue;
+	    }
+	    envelope = new Envelope(nil, nil, 0, UNIDENTIFIED_SENDER, content,
+				    timestamp, ids[i], deviceId, urgent,
+				    header, onlineOnly);
 	    if (endpoint) {
-		online[deviceId] = endpoint;
+		if (online[endpoint]) {
+		    online[endpoint] += ({ envelope });
+		} else {
+		    online[endpoint] = ({ envelope });
+		}
 	    } else {
 		FCM_RELAY->sendNotification(account->device(deviceId)->gcmId(),
 					    urgent);
-		call_out_other(MESSAGE_SERVER, "stack", 0, ({ envelope }));
-		continue;
+		stacked += ({ envelope });
 	    }
 	}
+    }
 
-	call_out_other(endpoint, "deliver", 0, ({ envelope }));
+    for (endpoints = map_indices(online), i = sizeof(endpoints); --i >= 0; ) {
+	call_out_other(endpoints[i], "deliver", 0, online[endpoints[i]]);
+    }
+    if (sizeof(stacked) != 0) {
+	call_out_other(MESSAGE_SERVER, "stack", 0, stacked);
     }
 
-    respondJson(context, HTTP_OK, ([ "needsSync" : FALSE ]));
+    respondJson(context, HTTP_OK, ([ "uuids404" : notFound ]));
+}
+
+/*
+ * fetch a page of stored messages, for clients that poll
+ */
+static int getMessages(string context, Account account, Device device)
+{
+    Envelope *envelopes;
+    mapping *list;
+    int more, i;
+
+    ({ envelopes, more }) = MESSAGE_SERVER->fetch(account->id(), device->id(),
+						  MESSAGE_PAGE);
+    list = allocate(i = sizeof(envelopes));
+    while (--i >= 0) {
+	list[i] = envelopes[i]->entity();
+    }
+    return respondJson(context, HTTP_OK, ([
+	"messages" : list,
+	"more" : more
+    ]));
 }
 
 /*
- * send one envelope to the client
+ * remove a stored message after the client has fetched it
+ */
+static int deleteMessage(string context, string guid, Account account,
+			 Device device)
+{
+    Envelope envelope;
+
+    try {
+	guid = uuid::decode(guid);
+    } catch (...) {
+	return respond(context, HTTP_BAD_REQUEST, nil, nil);
+    }
+    envelope = MESSAGE_SERVER->get(account->id(), guid);
+    if (!envelope || envelope->destinationId() != account->id() ||
+	envelope->destinationDeviceId() != device->id()) {
+	return respond(context, HTTP_NOT_FOUND, nil, nil);
+    }
+    MESSAGE_SERVER->acknowledge(account->id(), ({ guid }));
+    return respond(context, HTTP_NO_CONTENT, nil, nil);
+}
+
+/*
+ * envelopes sent to the client, for which no response was received yet
+ */
+private mapping inFlight()
+{
+    if (!inFlight) {
+	inFlight = ([ ]);
+    }
+    return inFlight;
+}
+
+/*
+ * the X-Signal-Timestamp header, shared by all envelopes sent in the same
+ * millisecond
+ */
+private mapping timestampHeader()
+{
+    int time;
+    float mtime;
+
+    ({ time, mtime }) = millitime();
+    if (!stamp || time != stampTime || mtime != stampMtime) {
+	stampTime = time;
+	stampMtime = mtime;
+	stamp = ([ "X-Signal-Timestamp" : new Timestamp->transport() ]);
+    }
+    return stamp;
+}
+
+/*
+ * send one envelope to the client, and redeliver it if there is no response
+ * in time
  */
 private void sendEnvelope(Envelope envelope)
 {
-    chatSendRequest("PUT", "/api/v1/message", envelope->transport(),
-    ([
-	"X-Signal-Timestamp" : new Timestamp->transport()
-    ]), new Continuation("delivered", envelope));
-    state = AWAIT_RESPONSE;
+    string context;
+
+    context = chatSendRequest("PUT", "/api/v1/message", envelope->transport(),
+			      timestampHeader(),
+			      new Continuation("delivered", envelope));
+    inFlight()[envelope->guid()] = ({
+	envelope, context,
+	call_out("redeliver", DELIVERY_TIMEOUT, envelope->guid())
+    });
 }
 
 /*
@@ -125,77 +557,308 @@ private void emptyQueue()
 }
 
 /*
- * deliver a stack of envelopes one by one
+ * envelope queue
+ */
+private Deque envelopeQueue()
+{
+    if (!envelopes) {
+	envelopes = new Deque((queue) ? queue : ({ }));
+	queue = nil;
+    }
+    return envelopes;
+}
+
+/*
+ * envelopes that may be stored in a mail box: online-only envelopes are
+ * dropped instead
+ */
+private Envelope *storable(Envelope *list)
+{
+    int i;
+
+    list = list[..];
+    for (i = sizeof(list); --i >= 0; ) {
+	if (list[i]->ephemeral()) {
+	    list[i] = nil;
+	}
+    }
+    return list - ({ nil });
+}
+
+/*
+ * send queued envelopes, as long as the delivery window is not full
+ */
+private void sendEnvelopes()
+{
+    Deque queue;
+
+    queue = envelopeQueue();
+    while (map_sizeof(inFlight()) < DELIVERY_WINDOW && queue->size() != 0 &&
+	   !congested()) {
+	sendEnvelope(queue->pop());
+    }
+}
+
+/*
+ * deliver a stack of envelopes, with several in flight at a time; while the
+ * client is not keeping up, they are parked in the mail box instead
+ */
+void deliver(Envelope *list)
+{
+    if (congested() && mailbox) {
+	list = storable(list);
+	if (sizeof(list) != 0) {
+	    MESSAGE_SERVER->stack(list);
+	    parked = TRUE;
+	    if (paging == PAGE_NONE) {
+		paging = PAGE_MORE;
+	    }
+	}
+	return;
+    }
+    envelopeQueue()->pushMany(list);
+    sendEnvelopes();
+}
+
+/*
+ * no timely response: send the envelope again
+ */
+static void redeliver(string guid)
+{
+    mixed *entry;
+
+    entry = inFlight()[guid];
+    if (entry) {
+	inFlight[guid] = nil;
+	chatCancelRequest(entry[1]);
+	sendEnvelope(entry[0]);
+    }
+}
+
+/*
+ * let the message server remove a stored envelope that was delivered
+ */
+static void acknowledgeStored(string accountId, string guid)
+{
+    MESSAGE_SERVER->acknowledge(accountId, ({ guid }));
+}
+
+/*
+ * request the first page of stored envelopes for a device that logged in
+ */
+static void chatDeliverStored(string accountId, int deviceId)
+{
+    paging = PAGE_REQUESTED;
+    emptied = FALSE;
+    mailbox = ({ accountId, deviceId });
+    call_out_other(MESSAGE_SERVER, "send", 0, accountId, deviceId,
+		   this_object());
+}
+
+/*
+ * request the next page of stored envelopes when the queue runs low, or tell
+ * the client once that the queue is empty when everything was delivered
+ */
+private void drain()
+{
+    if (!mailbox) {
+	return;		/* stored envelopes were never requested */
+    }
+    if (envelopeQueue()->size() < LOW_WATER && paging == PAGE_MORE) {
+	paging = PAGE_REQUESTED;
+	emptied = FALSE;
+	call_out_other(MESSAGE_SERVER, "send", 0, mailbox[0], mailbox[1],
+		       this_object(), TRUE);
+    } else if (envelopes->size() == 0 && map_sizeof(inFlight()) == 0 &&
+	       paging == PAGE_NONE && !emptied) {
+	emptied = TRUE;
+	emptyQueue();
+    }
+}
+
+/*
+ * deliver a page of envelopes that the message server keeps until their
+ * delivery is acknowledged
  */
-void deliver(Envelope *envelopes)
+void deliverStored(Envelope *list, varargs int more, string accountId,
+		   int deviceId)
 {
-    if (!queue) {
-	queue = envelopes;
+    int i;
+
+    if (!stored) {
+	stored = ([ ]);
+    }
+    for (i = sizeof(list); --i >= 0; ) {
+	stored[list[i]->guid()] = TRUE;
+    }
+    /* the page may have been taken before envelopes were parked */
+    paging = (more || parked) ? PAGE_MORE : PAGE_NONE;
+    parked = FALSE;
+    mailbox = ({ accountId, deviceId });
+    envelopeQueue()->pushMany(list);
+    sendEnvelopes();
+    drain();
+}
+
+/*
+ * the client caught up: resume delivery
+ */
+static void uncongested()
+{
+    sendEnvelopes();
+    drain();
+    ::uncongested();
+}
+
+/*
+ * collect a receipt, to be sent together with other receipts for the same
+ * sender
+ */
+private void addReceipt(object sender, Envelope receipt)
+{
+    string index;
+
+    if (!receipts) {
+	receipts = ([ ]);
+    }
+    if (map_sizeof(receipts) == 0) {
+	call_out("sendReceipts", RECEIPT_DELAY);
+    }
+    index = receipt->destinationDeviceId() + receipt->destinationId();
+    if (receipts[index]) {
+	receipts[index] += ({ receipt });
     } else {
-	queue += envelopes;
+	receipts[index] = ({ sender, receipt });
     }
+}
+
+/*
+ * send collected receipts, with a single call per sender and a single call
+ * for all senders that are offline
+ */
+static void sendReceipts()
+{
+    mixed **list;
+    Envelope *stacked;
+    object sender;
+    int count, calls, i;
 
-    if (state == READY) {
-	/* send envelope immediately */
-	sendEnvelope(queue[0]);
+    list = map_values(receipts);
+    receipts = ([ ]);
+    stacked = ({ });
+    for (i = sizeof(list); --i >= 0; ) {
+	sender = list[i][0];
+	count += sizeof(list[i]) - 1;
+	if (sender) {
+	    /* send receipts */
+	    call_out_other(sender, "deliver", 0, list[i][1 ..]);
+	    calls++;
+	} else {
+	    /* send receipts the circuitrous route */
+	    stacked += list[i][1 ..];
+	}
+    }
+    if (sizeof(stacked) != 0) {
+	call_out_other(MESSAGE_SERVER, "stack", 0, stacked);
+	calls++;
     }
+
+    MESSAGE_SERVER->countReceipts(count, calls);
 }
 
 /*
- * calback after delivery
+ * calback after delivery, in any order; without a response, the envelope is
+ * redelivered after a timeout, and an envelope that the client rejects is
+ * left in the mail box
  */
 static void delivered(Envelope envelope, int code)
 {
-    object sender;
+    mixed *entry;
 
-    if (code == HTTP_OK) {
-	queue = queue[1 ..];
-	state = READY;
+    entry = inFlight()[envelope->guid()];
+    if (!entry) {
+	return;
+    }
+    inFlight[envelope->guid()] = nil;
+    remove_call_out(entry[2]);
 
-	if (envelope->type() != RECEIPT) {
-	    sender = envelope->origin();
-	    envelope = new Envelope(this_object(), envelope->destinationId(),
+    if (code != HTTP_OK) {
+	/*
+	 * not accepted by the client: keep the envelope in the mail box, to
+	 * try again when the device reconnects
+	 */
+	if (stored && stored[envelope->guid()]) {
+	    stored[envelope->guid()] = nil;
+	} else if (!envelope->ephemeral()) {
+	    call_out_other(MESSAGE_SERVER, "stack", 0, ({ envelope }));
+	}
+    } else {
+	if (stored && stored[envelope->guid()]) {
+	    /* no longer needed by the message server */
+	    stored[envelope->guid()] = nil;
+	    call_out("acknowledgeStored", 0, envelope->destinationId(),
+		     envelope->guid());
+	}
+
+	if (envelope->type() != RECEIPT && envelope->sourceId()) {
+	    addReceipt(envelope->origin(),
+		       new Envelope(this_object(), envelope->destinationId(),
 				    envelope->destinationDeviceId(), RECEIPT,
 				    nil, envelope->timestamp(),
 				    envelope->sourceId(),
-				    envelope->sourceDeviceId(), FALSE);
-	    if (sender) {
-		/* send receipt */
-		call_out_other(sender, "deliver", 0, ({ envelope }));
-	    } else {
-		/* send receipt the circuitrous route */
-		call_out_other(MESSAGE_SERVER, "stack", 0, ({ envelope }));
-	    }
-	}
-
-	/* send next envelope, or EOM */
-	if (sizeof(queue) != 0) {
-	    sendEnvelope(queue[0]);
-	} else {
-	    emptyQueue();
+				    envelope->sourceDeviceId(), FALSE));
 	}
     }
+
+    /* send next envelopes, get the next page, or EOM */
+    sendEnvelopes();
+    drain();
 }
 
 /*
- * override close() to save message queue
+ * override close() to go offline and save message queue; envelopes from the
+ * mail box remain there, to be delivered again on reconnect
  */
 static void close()
 {
-    object *envelopes;
-    mixed **callouts;
+    Envelope *list;
+    mixed **callouts, **entries;
     int i, sz;
 
-    envelopes = (queue) ? queue : ({ });
+    chatUnregister();
+
+    /* envelopes in flight go first */
+    entries = map_values(inFlight());
+    list = allocate(sz = sizeof(entries));
+    for (i = 0; i < sz; i++) {
+	list[i] = entries[i][0];
+	remove_call_out(entries[i][2]);
+    }
+    inFlight = ([ ]);
+    list += envelopeQueue()->drain();
     callouts = status(this_object(), O_CALLOUTS);
     for (i = 0, sz = sizeof(callouts); i < sz; i++) {
 	if (callouts[i][CO_FUNCTION] == "deliver") {
-	    envelopes += callouts[i][CO_FIRSTXARG];
+	    list += callouts[i][CO_FIRSTXARG];
 	}
     }
+    if (stored) {
+	for (i = sizeof(list); --i >= 0; ) {
+	    if (stored[list[i]->guid()]) {
+		list[i] = nil;
+	    }
+	}
+	list -= ({ nil });
+	stored = ([ ]);
+    }
 
-    if (sizeof(envelopes) != 0) {
-	call_out_other(MESSAGE_SERVER, "stack", 0, envelopes);
+    list = storable(list);
+    if (sizeof(list) != 0) {
+	call_out_other(MESSAGE_SERVER, "stack", 0, list);
+    }
+    if (receipts && map_sizeof(receipts) != 0) {
+	remove_call_out("sendReceipts");
+	sendReceipts();
     }
 
     ::close();
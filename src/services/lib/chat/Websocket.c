@@ -50,8 +50,11 @@ private inherit uuid "~/lib/uuid";
 private inherit "~/lib/proto";
 
 mapping outgoing;		/* context : callback */
+mixed *presence;		/* ({ accountId, deviceId, generation }) */
 int provisioningDone;		/* provisioning finished */
 
+static void chatDeliverStored(string accountId, int deviceId);
+
 /*
  * initialize websocket layer
  */
@@ -119,19 +122,33 @@ static void getWebsocketLogin3(string context, string key, string login,
 {
     if (success) {
 	upgradeToWebSocket("chat", key, login, password);
-	ONLINE_REGISTRY->register(id, deviceId, this_object());
-	call_out_other(MESSAGE_SERVER, "send", 0, id, deviceId, this_object());
+	presence = ({
+	    id, deviceId,
+	    ONLINE_REGISTRY->register(id, deviceId, this_object())
+	});
+	chatDeliverStored(id, deviceId);
     } else {
 	respond(context, HTTP_UNAUTHORIZED, nil, nil);
     }
 }
 
 /*
- * send a WebSocket request
+ * no longer online
+ */
+static void chatUnregister()
+{
+    if (presence) {
+	ONLINE_REGISTRY->unregister(presence...);
+	presence = nil;
+    }
+}
+
+/*
+ * send a WebSocket request, and return its context
  */
-static void chatSendRequest(string verb, string path, StringBuffer body,
-			    mapping extraHeaders, Continuation cont,
-			    varargs mixed arguments...)
+static string chatSendRequest(string verb, string path, StringBuffer body,
+			      mapping extraHeaders, Continuation cont,
+			      varargs mixed arguments...)
 {
     string context;
     StringBuffer chunk;
@@ -146,6 +163,15 @@ static void chatSendRequest(string verb, string path, StringBuffer body,
 	context = "\1";		/* no response */
     }
     sendChunk(wsRequest(verb, path, body, extraHeaders, context));
+    return context;
+}
+
+/*
+ * stop waiting for the response to a WebSocket request
+ */
+static void chatCancelRequest(string context)
+{
+    outgoing[context] = nil;
 }
 
 /*
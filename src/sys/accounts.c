@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024-2025 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -17,41 +17,225 @@
  */
 
 # include <KVstore.h>
+# include "BloomFilter.h"
 # include "account.h"
 # include "services.h"
+# include <type.h>
 
 private inherit "/lib/util/random";
 private inherit uuid "~/lib/uuid";
 private inherit "~/lib/phone";
 
 
-object accounts;	/* accountId : account */
-object phoneIndex;	/* phoneNumber : accountId */
-object usernameIndex;	/* username : accountId */
+# define SHARDS		16	/* number of account shards */
+# define FILTER_PAGE	1000	/* accounts added to a new filter per task */
+# define FILTER_SAMPLE	16	/* single lookups per counted lookup */
+
+object accounts;	/* accountId : account, before sharding */
+object phoneIndex;	/* phoneNumber : accountId, before sharding */
+object usernameIndex;	/* username : accountId, before sharding */
 int version;		/* data version */
+object *shards;		/* account shards */
+BloomFilter filter;	/* registered phone numbers */
+BloomFilter building;	/* filter being filled from existing accounts */
+int queries;		/* phone numbers looked up with the filter */
+int rejected;		/* phone numbers rejected by the filter */
+int falsePositives;	/* phone numbers passed by the filter but not found */
+
+/*
+ * create account shards
+ */
+private void createShards()
+{
+    int i;
+
+    shards = allocate(SHARDS);
+    for (i = 0; i < SHARDS; i++) {
+	shards[i] = clone_object(ACCOUNT_SHARD);
+    }
+}
 
 /*
  * initialize account server
  */
 static void create()
 {
-    accounts = new KVstore(199);
-    phoneIndex = new KVstore(249);
-    usernameIndex = new KVstore(142);
+    createShards();
+    filter = new BloomFilter();
     version = 1;
 }
 
+/*
+ * select the shard for a key, which is either an account ID, a phone number
+ * in 8-byte form, or a username; the final byte of each is evenly distributed
+ */
+private object shard(string key)
+{
+    return shards[key[strlen(key) - 1] % sizeof(shards)];
+}
+
+/*
+ * get an account stored before sharding; an account stored as an object is
+ * viewed as a packed record, without storing it again
+ */
+private Account unsharded(string accountId)
+{
+    mixed account;
+
+    account = accounts[accountId];
+    if (typeof(account) == T_OBJECT) {
+	account = account->packed();
+    }
+    return (account) ? new Account(account) : nil;
+}
+
+/*
+ * pack accounts stored as objects in the shards; accounts stored before
+ * sharding cannot be listed, and remain viewed as packed records
+ */
+void pack()
+{
+    int i;
+
+    if (previous_program() == "/usr/MsgServer/initd" && shards) {
+	for (i = sizeof(shards); --i >= 0; ) {
+	    shards[i]->pack();
+	}
+    }
+}
+
+/*
+ * group keys by shard: ([ shard : ({ keys, positions }) ])
+ */
+private mapping groupByShard(string *keys)
+{
+    mapping groups;
+    mixed *group;
+    string key;
+    int sz, i;
+
+    groups = ([ ]);
+    for (sz = sizeof(keys), i = 0; i < sz; i++) {
+	key = keys[i];
+	if (key) {
+	    group = groups[shard(key)];
+	    if (!group) {
+		groups[shard(key)] = group = ({ ({ }), ({ }) });
+	    }
+	    group[0] += ({ key });
+	    group[1] += ({ i });
+	}
+    }
+    return groups;
+}
+
+/*
+ * count phone number lookups
+ */
+static void countQueries(float number)
+{
+    queries += (int) number;
+}
+
+/*
+ * count phone numbers rejected by the filter
+ */
+static void countRejected(float number)
+{
+    rejected += (int) number;
+}
+
+/*
+ * count phone numbers that passed the filter without being found
+ */
+static void countFalsePositives(float number)
+{
+    falsePositives += (int) number;
+}
+
+/*
+ * start filling a filter with the phone numbers of existing accounts, if
+ * there is none yet
+ */
+private void startFilter()
+{
+    if (!filter && !building && shards) {
+	building = new BloomFilter();
+	call_out("fillFilter", 0, 0, nil);
+    }
+}
+
+/*
+ * fill the new filter from one shard at a time, a page at a time; accounts
+ * added meanwhile are added to it directly.  Accounts from before sharding
+ * cannot be listed, so the index for those is checked even for numbers that
+ * the filter rejects
+ */
+static void fillFilter(int index, mixed *cursor)
+{
+    string *numbers;
+    int i;
+
+    ({ numbers, cursor }) = shards[index]->phoneNumbers(cursor, FILTER_PAGE);
+    for (i = sizeof(numbers); --i >= 0; ) {
+	if (numbers[i]) {
+	    building->add(phoneToNum(numbers[i]));
+	}
+    }
+
+    if (cursor) {
+	call_out("fillFilter", 0, index, cursor);
+    } else if (index + 1 < sizeof(shards)) {
+	call_out("fillFilter", 0, index + 1, nil);
+    } else {
+	filter = building;
+	building = nil;
+    }
+}
+
+/*
+ * update filter statistics without conflicts between concurrent lookups
+ */
+private void countFilter(int number, int negatives, int positives)
+{
+    call_out_summand("countQueries", 0, (float) number);
+    if (negatives != 0) {
+	call_out_summand("countRejected", 0, (float) negatives);
+    }
+    if (positives != 0) {
+	call_out_summand("countFalsePositives", 0, (float) positives);
+    }
+}
+
 /*
  * add new account
  */
 atomic void add(Account account)
 {
-    string accountId, username;
+    string accountId, phoneNumber, username;
+
+    if (!shards) {
+	createShards();
+    }
+
+    /* the shards do not know about indices from before sharding */
+    phoneNumber = phoneToNum(account->phoneNumber());
+    if (phoneIndex && (phoneIndex[phoneNumber] ||
+		       phoneIndex[account->phoneNumber()])) {
+	error("Duplicate phone number");
+    }
+    username = account->username();
+    if (username && usernameIndex && usernameIndex[username]) {
+	error("Duplicate username");
+    }
 
     for (;;) {
 	accountId = uuid::generate();
+	if (accounts && accounts[accountId]) {
+	    continue;
+	}
 	try {
-	    accounts->add(accountId, account);
+	    shard(accountId)->addAccount(accountId, account);
 	} catch (...) {
 	    continue;
 	}
@@ -63,10 +247,16 @@ atomic void add(Account account)
     /*
      * extra indices for the database
      */
-    phoneIndex->add(phoneToNum(account->phoneNumber()), accountId);
-    username = account->username();
+    shard(phoneNumber)->addPhoneNumber(phoneNumber, accountId);
+    if (filter) {
+	filter->add(phoneNumber);
+    } else if (building) {
+	building->add(phoneNumber);
+    } else {
+	startFilter();
+    }
     if (username) {
-	usernameIndex->add(username, accountId);
+	shard(username)->addUsername(username, accountId);
     }
 }
 
@@ -75,7 +265,49 @@ atomic void add(Account account)
  */
 Account get(string accountId)
 {
-    return accounts[accountId];
+    Account account;
+
+    if (shards) {
+	account = shard(accountId)->get(accountId);
+    }
+    if (!account && accounts) {
+	account = unsharded(accountId);
+    }
+    return account;
+}
+
+/*
+ * get multiple accounts by account ID, with a single call to each shard
+ */
+Account *getMany(string *accountIds)
+{
+    Account *list, *found;
+    mapping groups;
+    object *shardList;
+    mixed **groupList;
+    int *positions, i, j;
+
+    list = allocate(sizeof(accountIds));
+    if (shards) {
+	groups = groupByShard(accountIds);
+	shardList = map_indices(groups);
+	groupList = map_values(groups);
+	for (i = sizeof(shardList); --i >= 0; ) {
+	    found = shardList[i]->getMany(groupList[i][0]);
+	    positions = groupList[i][1];
+	    for (j = sizeof(found); --j >= 0; ) {
+		list[positions[j]] = found[j];
+	    }
+	}
+    }
+    if (accounts) {
+	for (i = sizeof(list); --i >= 0; ) {
+	    if (!list[i] && accountIds[i]) {
+		list[i] = unsharded(accountIds[i]);
+	    }
+	}
+    }
+    return list;
 }
 
 /*
@@ -83,13 +315,108 @@ Account get(string accountId)
  */
 Account getByNumber(string phoneNumber)
 {
-    string id;
+    string num, id;
+    int negative;
+
+    num = phoneToNum(phoneNumber);
+    if (filter) {
+	negative = !filter->contains(num);
+	if (!negative) {
+	    id = shard(num)->getIdByNumber(num);
+	}
+
+	/* count a sample, scaled up */
+	if (random(FILTER_SAMPLE) == 0) {
+	    countFilter(FILTER_SAMPLE, (negative) ? FILTER_SAMPLE : 0,
+			(!negative && !id) ? FILTER_SAMPLE : 0);
+	}
+    } else if (shards) {
+	startFilter();
+	id = shard(num)->getIdByNumber(num);
+    }
+    if (!id && phoneIndex) {
+	id = phoneIndex[num];
+	if (!id && version == 0) {
+	    id = phoneIndex[phoneNumber];
+	}
+    }
+    return (id) ? get(id) : nil;
+}
+
+/*
+ * get multiple accounts by phone number in 8-byte form, with a single call
+ * to each shard for the numbers that pass the filter
+ */
+Account *getManyByNum(string *nums)
+{
+    string *candidates, *ids, *found;
+    mapping groups;
+    object *shardList;
+    mixed **groupList;
+    int *positions, negatives, positives, i, j;
+
+    ids = allocate(sizeof(nums));
+    if (filter) {
+	candidates = allocate(i = sizeof(nums));
+	while (--i >= 0) {
+	    if (filter->contains(nums[i])) {
+		candidates[i] = nums[i];
+	    } else {
+		negatives++;
+	    }
+	}
+    } else {
+	startFilter();
+	candidates = nums;
+    }
+
+    if (shards) {
+	groups = groupByShard(candidates);
+	shardList = map_indices(groups);
+	groupList = map_values(groups);
+	for (i = sizeof(shardList); --i >= 0; ) {
+	    found = shardList[i]->getIdsByNumber(groupList[i][0]);
+	    positions = groupList[i][1];
+	    for (j = sizeof(found); --j >= 0; ) {
+		ids[positions[j]] = found[j];
+	    }
+	}
+    }
+    if (phoneIndex) {
+	for (i = sizeof(ids); --i >= 0; ) {
+	    if (!ids[i] && nums[i]) {
+		ids[i] = phoneIndex[nums[i]];
+		if (!ids[i] && version == 0) {
+		    ids[i] = phoneIndex[numToPhone(nums[i])];
+		}
+	    }
+	}
+    }
+
+    if (filter) {
+	for (i = sizeof(ids); --i >= 0; ) {
+	    if (candidates[i] && !ids[i]) {
+		positives++;
+	    }
+	}
+	countFilter(sizeof(nums), negatives, positives);
+    }
+    return getMany(ids);
+}
 
-    id = phoneIndex[phoneToNum(phoneNumber)];
-    if (!id && version == 0) {
-	id = phoneIndex[phoneNumber];
+/*
+ * get multiple accounts by phone number
+ */
+Account *getManyByNumber(string *phoneNumbers)
+{
+    string *nums;
+    int i;
+
+    nums = allocate(i = sizeof(phoneNumbers));
+    while (--i >= 0) {
+	nums[i] = phoneToNum(phoneNumbers[i]);
     }
-    return (id) ? accounts[id] : nil;
+    return getManyByNum(nums);
 }
 
 /*
@@ -97,5 +424,32 @@ Account getByNumber(string phoneNumber)
  */
 Account getByName(string username)
 {
-    return accounts[usernameIndex[username]];
+    string id;
+
+    if (shards) {
+	id = shard(username)->getIdByName(username);
+    }
+    if (!id && usernameIndex) {
+	id = usernameIndex[username];
+    }
+    return (id) ? get(id) : nil;
+}
+
+/*
+ * phone number filter statistics
+ */
+mapping filterStatistics()
+{
+    int negatives;
+
+    negatives = rejected + falsePositives;
+    return ([
+	"queries" : queries,
+	"rejected" : rejected,
+	"falsePositives" : falsePositives,
+	"hitRate" : (queries != 0) ?
+		     (float) (queries - negatives) / (float) queries : 0.0,
+	"falsePositiveRate" : (negatives != 0) ?
+			       (float) falsePositives / (float) negatives : 0.0
+    ]);
 }
@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -16,7 +16,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-# include <KVstore.h>
+# include "KVstoreOrd.h"
 
 
 object keys;	/* accountId : keys */
@@ -26,7 +26,7 @@ object keys;	/* accountId : keys */
  */
 static void create()
 {
-    keys = new KVstore(199);
+    keys = new KVstoreOrd(199);
 }
 
 /*
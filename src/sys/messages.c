@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -19,86 +19,322 @@
 
 # include <String.h>
 # include <Continuation.h>
-# include <KVstore.h>
 # include "~HTTP/HttpResponse.h"
-# include "KVstoreExp.h"
-# include "Timestamp.h"
 # include "account.h"
 # include "messages.h"
+# include "services.h"
 
+inherit "~/lib/sweeper";
 
-# define DURATION	30 * 24 * 3600
+
+# define SHARDS		16	/* number of message shards */
+# define MAILBOX_PAGE	100	/* stored envelopes per page */
+# define REPLAY_WAIT	1	/* seconds to wait for journal replay */
 
 # define QUEUE		0
 # define ENDPOINT	1
 
-object messages;	/* messages */
-object mboxes;		/* mail boxes */
+object messages;	/* messages, before sharding */
+object mboxes;		/* mail boxes, before sharding */
+object *shards;		/* message shards */
+int receipts;		/* receipts sent */
+int receiptCalls;	/* calls made to send receipts */
+
+/*
+ * create message shards
+ */
+private void createShards()
+{
+    int i;
+
+    shards = allocate(SHARDS);
+    for (i = 0; i < SHARDS; i++) {
+	shards[i] = clone_object(MESSAGE_SHARD);
+    }
+}
 
 /*
  * initialize message server
  */
 static void create()
 {
-    messages = new KVstoreExp(199, DURATION);
-    mboxes = new KVstore(194);
+    createShards();
+}
+
+/*
+ * stores with expiring keys, before sharding
+ */
+static object *expiringStores()
+{
+    return (messages) ? ({ messages }) : ({ });
+}
+
+/*
+ * select the shard for a destination account; the final byte of the account
+ * ID is evenly distributed
+ */
+private object shard(string accountId)
+{
+    return shards[accountId[strlen(accountId) - 1] % sizeof(shards)];
 }
 
 /*
- * keep a stack of envelopes to send later
+ * keep a stack of envelopes to send later, for one or more mailboxes, with a
+ * single call to each shard
  */
 atomic void stack(Envelope *envelopes)
 {
-    Envelope envelope;
-    string index, guid;
-    mapping mbox;
+    mapping groups;
+    object *shardList;
+    Envelope **groupList;
+    object obj;
     int i, sz;
 
-    /* add to message queue */
-    envelope = envelopes[0];
-    index = envelope->destinationDeviceId() + envelope->destinationId();
-    mbox = mboxes[index];
-    if (!mbox) {
-	mboxes[index] = mbox = ([ QUEUE : ({ }) ]);
+    if (!shards) {
+	createShards();
     }
+
+    groups = ([ ]);
     for (i = 0, sz = sizeof(envelopes); i < sz; i++) {
-	envelope = envelopes[i];
-	guid = envelope->guid();
-	messages->add(guid, envelope);
-	mbox[QUEUE] += ({ guid });
+	obj = shard(envelopes[i]->destinationId());
+	if (groups[obj]) {
+	    groups[obj] += ({ envelopes[i] });
+	} else {
+	    groups[obj] = ({ envelopes[i] });
+	}
+    }
+
+    shardList = map_indices(groups);
+    groupList = map_values(groups);
+    for (i = sizeof(shardList); --i >= 0; ) {
+	shardList[i]->stack(groupList[i]);
     }
 }
 
 /*
- * send a stack of envelopes
+ * take envelopes stacked before sharding
  */
-atomic void send(string accountId, int deviceId, object endpoint)
+private atomic Envelope *unsharded(string accountId, int deviceId)
 {
     mapping mbox;
-    string *queue, guid;
-    Envelope *envelopes, envelope;
-    int i, sz;
+    string *queue;
+
+    mbox = mboxes[deviceId + accountId];
+    if (mbox) {
+	queue = mbox[QUEUE];
+	if (queue && sizeof(queue) != 0) {
+	    mbox[QUEUE] = ({ });
+	    return messages->getMany(queue) - ({ nil });
+	}
+    }
+    return ({ });
+}
+
+/*
+ * move envelopes stacked before sharding to their shard, and sweep what
+ * expires before it is moved
+ */
+private void migrate(string accountId, int deviceId)
+{
+    Envelope *envelopes;
+
+    if (mboxes) {
+	startSweeper();
+	envelopes = unsharded(accountId, deviceId);
+	if (sizeof(envelopes) != 0) {
+	    stack(envelopes);
+	}
+    }
+}
+
+/*
+ * restored from a snapshot: replay the journals of all shards
+ */
+void reboot()
+{
+    int i;
+
+    if (previous_program() == "/usr/MsgServer/initd" && shards) {
+	for (i = sizeof(shards); --i >= 0; ) {
+	    shards[i]->reboot();
+	}
+    }
+}
+
+/*
+ * send the next page of stored envelopes to a connected device, even if
+ * there are none; when the device (re)connects, delivery resumes with the
+ * first envelope that was not acknowledged
+ */
+void send(string accountId, int deviceId, object endpoint,
+	  varargs int continued)
+{
+    mixed *page;
 
     if (endpoint) {
-	mbox = mboxes[deviceId + accountId];
-	if (mbox) {
-	    queue = mbox[QUEUE];
-	    if (queue && sizeof(queue) != 0) {
-		mbox[QUEUE] = ({ });
-		envelopes = ({ });
-
-		for (i = 0, sz = sizeof(queue); i < sz; i++) {
-		    guid = queue[i];
-		    envelope = messages[guid];
-		    if (envelope) {
-			envelopes += ({ envelope });
-		    }
-		}
+	if (!continued) {
+	    migrate(accountId, deviceId);
+	}
+	if (shards) {
+	    page = shard(accountId)->next(accountId, deviceId, MAILBOX_PAGE,
+					  !continued);
+	    if (!page) {
+		/* wait until the journal has been replayed */
+		call_out("send", REPLAY_WAIT, accountId, deviceId, endpoint,
+			 continued);
+		return;
+	    }
+	} else {
+	    page = ({ ({ }), FALSE });
+	}
+	call_out_other(endpoint, "deliverStored", 0, page[0], page[1],
+		       accountId, deviceId);
+    }
+}
+
+/*
+ * fetch a page of stacked envelopes without taking them: ({ envelopes, more })
+ */
+mixed *fetch(string accountId, int deviceId, int n)
+{
+    if (previous_program() == MessagesService ||
+	previous_program() == ChatServices) {
+	migrate(accountId, deviceId);
+	return (shards) ? shard(accountId)->fetch(accountId, deviceId, n) :
+			  ({ ({ }), FALSE });
+    }
+}
+
+/*
+ * get a stored envelope for an account
+ */
+Envelope get(string accountId, string guid)
+{
+    if (previous_program() == MessagesService ||
+	previous_program() == ChatServices) {
+	Envelope envelope;
 
-		if (sizeof(envelopes) != 0) {
-		    call_out_other(endpoint, "deliver", 0, envelopes);
+	if (shards) {
+	    envelope = shard(accountId)->get(guid);
+	}
+	return (!envelope && messages) ? messages[guid] : envelope;
+    }
+}
+
+/*
+ * remove stored envelopes of which delivery was acknowledged
+ */
+void acknowledge(string accountId, string *guids)
+{
+    if (previous_program() == MessagesService ||
+	previous_program() == ChatServices) {
+	int i;
+
+	if (messages) {
+	    for (i = sizeof(guids); --i >= 0; ) {
+		if (messages[guids[i]]) {
+		    messages[guids[i]] = nil;
 		}
 	    }
 	}
+	if (shards) {
+	    shard(accountId)->remove(guids);
+	}
+    }
+}
+
+/*
+ * count receipts sent in batches
+ */
+void countReceipts(int number, int calls)
+{
+    if (previous_program() == MessagesService) {
+	call_out_summand("addReceipts", 0, (float) number);
+	call_out_summand("addReceiptCalls", 0, (float) calls);
+    }
+}
+
+/*
+ * count receipts sent
+ */
+static void addReceipts(float number)
+{
+    receipts += (int) number;
+}
+
+/*
+ * count calls made to send receipts
+ */
+static void addReceiptCalls(float number)
+{
+    receiptCalls += (int) number;
+}
+
+/*
+ * receipt status: ({ receipts sent, calls made to send them })
+ */
+int *receiptStatus()
+{
+    return ({ receipts, receiptCalls });
+}
+
+/*
+ * sweep statistics for all shards: ({ reclaimed entries, reclaimed bytes })
+ */
+int *sweepStatus()
+{
+    int *status, *shardStatus;
+    int i;
+
+    status = ::sweepStatus();
+    if (shards) {
+	for (i = sizeof(shards); --i >= 0; ) {
+	    shardStatus = shards[i]->sweepStatus();
+	    status[0] += shardStatus[0];
+	    status[1] += shardStatus[1];
+	}
+    }
+    return status;
+}
+
+/*
+ * envelope status for all shards: ({ resident envelopes, envelopes removed
+ * after delivery, expired envelopes removed from mail boxes, envelopes
+ * spilled to segments })
+ */
+int *envelopeStatus()
+{
+    int *status, *shardStatus;
+    int i;
+
+    status = ({ 0, 0, 0, 0 });
+    if (shards) {
+	for (i = sizeof(shards); --i >= 0; ) {
+	    shardStatus = shards[i]->envelopeStatus();
+	    status[0] += shardStatus[0];
+	    status[1] += shardStatus[1];
+	    status[2] += shardStatus[2];
+	    status[3] += shardStatus[3];
+	}
+    }
+    return status;
+}
+
+/*
+ * journal status for all shards: ({ records written, records replayed })
+ */
+int *journalStatus()
+{
+    int *status, *shardStatus;
+    int i;
+
+    status = ({ 0, 0 });
+    if (shards) {
+	for (i = sizeof(shards); --i >= 0; ) {
+	    shardStatus = shards[i]->journalStatus();
+	    status[0] += shardStatus[0];
+	    status[1] += shardStatus[1];
+	}
     }
+    return status;
 }
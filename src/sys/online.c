@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -17,25 +17,68 @@
  */
 
 
+# include <KVstore.h>
 # include "KVstoreObj.h"
+# include "account.h"
 
 
-object endpoints;	/* connected WebSocket endpoints */
+# define SHARDS		16	/* number of online shards */
+
+object endpoints;	/* connected WebSocket endpoints, before sharding */
+object *shards;		/* online shards */
+
+/*
+ * create online shards
+ */
+private void createShards()
+{
+    int i;
+
+    shards = allocate(SHARDS);
+    for (i = 0; i < SHARDS; i++) {
+	shards[i] = clone_object(ONLINE_SHARD);
+    }
+}
 
 /*
  * initialize online registry
  */
 static void create()
 {
-    endpoints = new KVstoreObj(194);
+    createShards();
+}
+
+/*
+ * select the shard for an account; the final byte of the account ID is
+ * evenly distributed
+ */
+private object shard(string id)
+{
+    if (!shards) {
+	createShards();
+    }
+    return shards[id[strlen(id) - 1] % sizeof(shards)];
 }
 
 /*
- * register WebSocket endpoint
+ * register WebSocket endpoint, and return the generation to unregister it
+ * with
  */
-void register(string id, int deviceId, object endpoint)
+int register(string id, int deviceId, object endpoint)
 {
-    endpoints[deviceId + id] = endpoint;
+    if (endpoints && endpoints[deviceId + id]) {
+	endpoints[deviceId + id] = nil;
+    }
+    return shard(id)->register(id, deviceId, endpoint);
+}
+
+/*
+ * unregister the calling WebSocket endpoint, if it wasn't replaced by a
+ * newer one
+ */
+void unregister(string id, int deviceId, int generation)
+{
+    shard(id)->unregister(id, deviceId, generation, previous_object());
 }
 
 /*
@@ -43,5 +86,69 @@ void register(string id, int deviceId, object endpoint)
  */
 object present(string id, int deviceId)
 {
-    return endpoints[deviceId + id];
+    object endpoint;
+
+    endpoint = shard(id)->present(id, deviceId);
+    if (!endpoint && endpoints) {
+	endpoint = endpoints[deviceId + id];
+    }
+    return endpoint;
+}
+
+/*
+ * get the active WebSocket endpoints of an account: ([ deviceId : endpoint ]);
+ * endpoints registered before sharding are only found for the given devices
+ */
+mapping online(string id, varargs int *deviceIds)
+{
+    mapping devices;
+    object endpoint;
+    int i;
+
+    devices = shard(id)->online(id);
+    if (endpoints && deviceIds) {
+	for (i = sizeof(deviceIds); --i >= 0; ) {
+	    if (!devices[deviceIds[i]] &&
+		(endpoint=endpoints[deviceIds[i] + id])) {
+		devices[deviceIds[i]] = endpoint;
+	    }
+	}
+    }
+    return devices;
+}
+
+/*
+ * get the active WebSocket endpoints of multiple accounts
+ */
+mapping *onlineMany(string *ids, varargs int **deviceIds)
+{
+    mapping *list;
+    int i;
+
+    list = allocate(i = sizeof(ids));
+    while (--i >= 0) {
+	list[i] = online(ids[i], (deviceIds) ? deviceIds[i] : nil);
+    }
+    return list;
+}
+
+/*
+ * online status for all shards: ({ online devices, registrations,
+ * unregistrations })
+ */
+int *onlineStatus()
+{
+    int *status, *shardStatus;
+    int i;
+
+    status = ({ 0, 0, 0 });
+    if (shards) {
+	for (i = sizeof(shards); --i >= 0; ) {
+	    shardStatus = shards[i]->onlineStatus();
+	    status[1] += shardStatus[0];
+	    status[2] += shardStatus[1];
+	}
+	status[0] = status[1] - status[2];
+    }
+    return status;
 }
@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024-2025 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -17,6 +17,7 @@
  */
 
 # include <KVstore.h>
+# include "KVindexed.h"
 # include "account.h"
 # include "services.h"
 
@@ -28,6 +29,7 @@ private inherit "~/lib/phone";
 object pni;	/* phoneNumber : Id */
 object ipn;	/* id : phoneNumber */
 int version;	/* data version */
+object store;	/* ipn, indexed by phone number */
 
 /*
  * initialize PNI server
@@ -39,23 +41,38 @@ static void create()
     version = 1;
 }
 
+/*
+ * indexed PNI store
+ */
+private object indexed()
+{
+    if (!store) {
+	store = new KVindexed(this_object(), ipn, ([
+	    "phone" : ({ pni, "phoneKey" })
+	]));
+    }
+    return store;
+}
+
+/*
+ * phone index key of a phone number
+ */
+string phoneKey(string phoneNumber)
+{
+    return phoneToNum(phoneNumber);
+}
+
 /*
  * add a new phoneNumber : ID
  */
-private atomic string add(string phoneNumber)
+private string add(string phoneNumber)
 {
     string id;
 
-    for (;;) {
+    do {
 	id = uuid::generate();
-	try {
-	    ipn->add(id, phoneNumber);
-	} catch (...) {
-	    continue;
-	}
-	break;
-    }
-    pni[phoneToNum(phoneNumber)] = id;
+    } while (ipn[id]);
+    indexed()->set(id, phoneNumber);
 
     return id;
 }
@@ -67,7 +84,7 @@ string getId(string phoneNumber)
 {
     string id;
 
-    id = pni[phoneToNum(phoneNumber)];
+    id = indexed()->lookup("phone", phoneToNum(phoneNumber));
     if (!id && version == 0) {
 	id = pni[phoneNumber];
     }
@@ -79,5 +96,21 @@ string getId(string phoneNumber)
  */
 string getPhoneNumber(string id)
 {
-    return ipn[id];
+    return indexed()->get(id);
+}
+
+/*
+ * get phone numbers for multiple PNIs
+ */
+string *getPhoneNumbers(string *ids)
+{
+    return indexed()->getMany(ids);
+}
+
+/*
+ * index memory statistics
+ */
+mapping statistics()
+{
+    return indexed()->statistics();
 }
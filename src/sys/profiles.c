@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -17,7 +17,7 @@
  */
 
 
-# include <KVstore.h>
+# include "KVstoreOrd.h"
 # include "account.h"
 
 
@@ -28,7 +28,7 @@ object profiles;	/* id : profile */
  */
 static void create()
 {
-    profiles = new KVstore(110);
+    profiles = new KVstoreOrd(110);
 }
 
 Profile get(string id, string version)
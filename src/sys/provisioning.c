@@ -19,6 +19,7 @@
 # include "KVstoreExp.h"
 
 private inherit "~/lib/phone";
+inherit "~/lib/sweeper";
 
 
 # define DURATION	1 * 24 * 3600
@@ -35,6 +36,14 @@ static void create()
     verificationCodes = new KVstoreExp(249, DURATION);
 }
 
+/*
+ * stores with expiring keys
+ */
+static object *expiringStores()
+{
+    return ({ verificationCodes });
+}
+
 /*
  * register an endpoint with an address
  */
@@ -56,6 +65,7 @@ object getEndpoint(string provisioningAddr)
  */
 void storeVerificationCode(string phoneNumber, string code)
 {
+    startSweeper();
     verificationCodes[phoneToNum(phoneNumber)] = code;
 }
 
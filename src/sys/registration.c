@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -17,17 +17,20 @@
  */
 
 # include "KVstoreExp.h"
+# include "KVindexed.h"
 # include "services.h"
 
 private inherit "/lib/util/random";
 private inherit hex "/lib/util/hex";
 private inherit "~/lib/phone";
+inherit "~/lib/sweeper";
 
 
 # define DURATION	30 * 24 * 3600
 
 object sessions;	/* session mappings */
 object phoneIndex;	/* phoneNumber : sessionId */
+object store;		/* sessions, indexed by phone number */
 
 /*
  * initialize registration server
@@ -38,35 +41,66 @@ static void create()
     phoneIndex = new KVstoreExp(249, DURATION);
 }
 
+/*
+ * indexed session store
+ */
+private object indexed()
+{
+    if (!store) {
+	store = new KVindexed(this_object(), sessions, ([
+	    "phone" : ({ phoneIndex, "sessionPhone" })
+	]));
+    }
+    return store;
+}
+
+/*
+ * phone index key of a session
+ */
+string sessionPhone(mapping session)
+{
+    return phoneToNum(session["phoneNumber"]);
+}
+
+/*
+ * stores with expiring keys
+ */
+static object *expiringStores()
+{
+    return ({ sessions, phoneIndex });
+}
+
 /*
  * get session ID and session, creating a new session if needed
  */
 mixed *getSessionId(string phoneNumber)
 {
     if (previous_program() == RegistrationService) {
-	string sessionId;
+	string number, sessionId;
 	mapping session;
 
-	sessionId = phoneIndex[phoneToNum(phoneNumber)];
+	number = phoneToNum(phoneNumber);
+	sessionId = indexed()->lookup("phone", number);
 	if (sessionId) {
-	    return ({ sessionId, sessions[sessionId] });
+	    if (strlen(sessionId) != 16) {
+		sessionId = hex::decodeString(sessionId);	/* hex ID */
+	    }
+	    session = sessions[sessionId];
+	    if (session) {
+		return ({ hex::format(sessionId), session });
+	    }
 	}
 
-	session = ([ "phoneNumber" : phoneNumber ]);
-
-	for (;;) {
+	startSweeper();
+	do {
 	    sessionId = random_string(16);
-	    try {
-		sessions->add(sessionId, session);
-	    } catch (...) {
-		continue;
-	    }
-	    sessionId = hex::format(sessionId);
-	    session["id"] = sessionId;
-	    return ({
-		phoneIndex[phoneToNum(phoneNumber)] = sessionId, session
-	    });
-	}
+	} while (sessions[sessionId]);
+	session = ([
+	    "phoneNumber" : phoneNumber,
+	    "id" : hex::format(sessionId)
+	]);
+	indexed()->set(sessionId, session);	/* replaces an expired session */
+	return ({ session["id"], session });
     }
 }
 
@@ -86,13 +120,14 @@ mapping getSession(string sessionId)
 void remove(string sessionId)
 {
     if (previous_program() == RegistrationService) {
-	mapping values;
-
-	sessionId = hex::decodeString(sessionId);
-	values = sessions[sessionId];
-	if (values) {
-	    phoneIndex[phoneToNum(values["phoneNumber"])] = nil;
-	    sessions[sessionId] = nil;
-	}
+	indexed()->remove(hex::decodeString(sessionId));
     }
 }
+
+/*
+ * index memory statistics
+ */
+mapping statistics()
+{
+    return indexed()->statistics();
+}
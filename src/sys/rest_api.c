@@ -1,6 +1,6 @@
 /*
  * This file is part of https://github.com/LPC-language/signal-server
- * Copyright (C) 2024 Dworkin B.V.  All rights reserved.
+ * Copyright (C) 2024-2026 Dworkin B.V.  All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU Affero General Public License as
@@ -52,21 +52,27 @@ void register(string host, string method, string path, string function,
  */
 mixed *lookup(string host, string method, string path)
 {
-    string *args, *a, str;
+    string *args, *a, str, query;
     mapping map;
     int sz, i;
     mixed *call;
 
     args = ({ });
     map = api;
-    sscanf(path, "%s?%s", path, str);
+    sscanf(path, "%s?%s", path, query);
     a = ({ host, method }) + explode(path + "/", "/");
     sz = sizeof(a);
-    if (str) {
-	a[sz - 1] += "?" + str;
-    }
     for (i = 0; i < sz; i++) {
 	str = a[i];
+	if (query && i == sz - 1) {
+	    if (map[str + "?{}"]) {
+		/* path registered with a query argument */
+		map = map[str + "?{}"];
+		args += ({ query });
+		break;
+	    }
+	    str += "?" + query;
+	}
 	if (map[str]) {
 	    map = map[str];
 	} else if (map["{}"]) {